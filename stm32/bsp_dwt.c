@@ -47,8 +47,11 @@ void BSP_DWT_Init(void)
 #elif defined(CoreDebug)
     CoreDebug->DEMCR = CoreDebug_DEMCR_TRCENA_Msk;
 #endif
-    DWT->CTRL  |= DWT_CTRL_CYCCNTENA_Msk;
-    DWT->CYCCNT = 0U;
+    /* Drivers call this too, only the first call resets the counter */
+    if ((DWT->CTRL & DWT_CTRL_CYCCNTENA_Msk) == 0U) {
+        DWT->CYCCNT = 0U;
+        DWT->CTRL  |= DWT_CTRL_CYCCNTENA_Msk;
+    }
 
     cycles_per_us = SystemCoreClock / 1000000;
     max_safe_us = 0xFFFFFFFFU / cycles_per_us;
@@ -28,21 +28,6 @@
 /* Private define ------------------------------------------------------------*/
 
 /* Private macro -------------------------------------------------------------*/
-/*
- * Combine the port number (port) and the pin number (pin) into an 8-bit
- * unique identifier (pin_id), with the port number in the high 4 bits and
- * the pin number in the low 4 bits
- */
-#define PIN_ID(port, pin)           (((((port) & 0xFu) << 4) | ((pin) & 0x0Fu)))
-
-/* Get the port index from the pin_id */
-#define GET_PORT_IDX(pin_id)        ((uint8_t)(((pin_id) >> 4) & 0x0Fu))
-
-/* Get the pin index from the pin_id */
-#define PIN_GET_PIN_IDX(pin_id)     ((uint8_t)((pin_id) & 0x0Fu))
-
-/* Pin mask on port(eg. GPIO_PIN_0, GPIO_PIN_1) */
-#define PIN_MASK(pin_id)            ((uint16_t)(1u << PIN_GET_PIN_IDX(pin_id)))
 
 /* EXTI NVIC preemption priority (must match HAL_NVIC_SetPriority in irq_enable). */
 #define BSP_GPIO_EXTI_IRQ_PRIORITY    (5U)
@@ -740,6 +725,20 @@ void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin)
 //    if ((pending & GPIO_PIN_15) != 0U) { HAL_GPIO_EXTI_IRQHandler(GPIO_PIN_15); }
 //}
 
+/**
+ * @brief Look up the GPIO port of a pin id
+ * @param pin_id Pin id, see PIN_ID()
+ * @return Port registers, NULL if the port does not exist on this part
+ */
+GPIO_TypeDef *BSP_GPIO_GetPort(uint8_t pin_id)
+{
+    if (GET_PORT_IDX(pin_id) >= (sizeof(gpio_ports) / sizeof(gpio_ports[0]))) {
+        return NULL;
+    }
+
+    return gpio_ports[GET_PORT_IDX(pin_id)];
+}
+
 /**
  * @brief Initialize BSP GPIO
  * @return None
@@ -23,17 +23,35 @@
 
 /* Includes ------------------------------------------------------------------*/
 #include <stdint.h>
+#include "main.h"
 
 /* Exported define -----------------------------------------------------------*/
 
 /* Exported typedef ----------------------------------------------------------*/
 
 /* Exported macro ------------------------------------------------------------*/
+/*
+ * Combine the port number (port) and the pin number (pin) into an 8-bit
+ * unique identifier (pin_id), with the port number in the high 4 bits and
+ * the pin number in the low 4 bits
+ */
+#define PIN_ID(port, pin)           (((((port) & 0xFu) << 4) | ((pin) & 0x0Fu)))
+
+/* Get the port index from the pin_id */
+#define GET_PORT_IDX(pin_id)        ((uint8_t)(((pin_id) >> 4) & 0x0Fu))
+
+/* Get the pin index from the pin_id */
+#define PIN_GET_PIN_IDX(pin_id)     ((uint8_t)((pin_id) & 0x0Fu))
+
+/* Pin mask on port(eg. GPIO_PIN_0, GPIO_PIN_1) */
+#define PIN_MASK(pin_id)            ((uint16_t)(1u << PIN_GET_PIN_IDX(pin_id)))
+
 
 /* Exported variable prototypes ----------------------------------------------*/
 
 /* Exported function prototypes ----------------------------------------------*/
 int32_t BSP_GPIO_Init(void);
+GPIO_TypeDef *BSP_GPIO_GetPort(uint8_t pin_id);
 
 #ifdef __cplusplus
 }
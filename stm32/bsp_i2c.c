@@ -19,6 +19,9 @@
 #include "bsp_conf.h"
 #include "stm32f1xx_hal_i2c.h"
 #include "errno-base.h"
+#include "system_stm32f1xx.h"  /* For SystemCoreClock */
+#include "bsp_dwt.h"
+#include <string.h>
 
 /* FreeRTOS support */
 #if defined(USING_FREERTOS) || defined(configUSE_MUTEXES)
@@ -44,6 +47,9 @@ struct stm32_i2c_seq_ctx {
     volatile uint8_t      active;     /**< Context in use flag */
     volatile uint8_t      done;       /**< Transfer finished flag */
     volatile HAL_StatusTypeDef result;/**< Result of last HAL operation */
+    struct bsp_i2c_group *groups;     /**< Batch groups, NULL for a single transfer */
+    uint16_t              group_num;  /**< Number of batch groups */
+    uint16_t              group_idx;  /**< Batch group in progress */
 };
 
 /**
@@ -52,6 +58,22 @@ struct stm32_i2c_seq_ctx {
 struct stm32_i2c_hw {
     I2C_HandleTypeDef      hi2c;      /**< HAL I2C handle */
     struct stm32_i2c_seq_ctx seq;     /**< Sequential transfer context */
+    DMA_HandleTypeDef      hdma_tx;   /**< TX DMA, Instance NULL without DMA */
+    DMA_HandleTypeDef      hdma_rx;   /**< RX DMA, Instance NULL without DMA */
+    IRQn_Type              dma_tx_irq;/**< TX DMA channel interrupt */
+    IRQn_Type              dma_rx_irq;/**< RX DMA channel interrupt */
+    uint32_t               speed_hz;  /**< Achieved SCL rate */
+    struct bsp_i2c_stats   stats;     /**< Telemetry, lat_avg/busy_permille unused */
+    uint64_t               lat_sum;   /**< Sum of transaction latencies (DWT cycles) */
+    uint32_t               stats_since; /**< HAL tick of the last stats reset */
+    uint32_t               xfer_start;/**< DWT stamp of the current transaction start */
+    volatile uint32_t      xfer_end;  /**< DWT stamp of the last sequence completion */
+#if defined(USING_FREERTOS) || defined(configUSE_MUTEXES)
+    SemaphoreHandle_t      done_sem;  /**< Given from ISR when the sequence ends */
+    StaticSemaphore_t      done_sem_buf; /**< Storage for done_sem */
+    SemaphoreHandle_t      bus_lock;  /**< Held by core transfers and batches */
+    StaticSemaphore_t      bus_lock_buf; /**< Storage for bus_lock */
+#endif
 };
 
 enum
@@ -71,6 +93,51 @@ enum
     #define I2C_TIMEOUT_MS  (50U)
 #endif
 
+/* Event/error interrupt priority; the callbacks use FreeRTOS FromISR APIs,
+   so keep it numerically at or above the max syscall priority */
+#ifndef BSP_I2C_IRQ_PRIORITY
+    #define BSP_I2C_IRQ_PRIORITY  (5U)
+#endif
+
+/* SCL rate programmed at init, changeable with bsp_i2c_set_speed() */
+#ifndef BSP_I2C_DEFAULT_SPEED_HZ
+    #define BSP_I2C_DEFAULT_SPEED_HZ  (I2C_MAX_STANDARD_MODE_FREQ)
+#endif
+
+/* Minimum PCLK1 for standard and fast mode (RM0008, I2C_CR2.FREQ) */
+#define STM32_I2C_MIN_PCLK_SM     (2000000U)
+#define STM32_I2C_MIN_PCLK_FM     (4000000U)
+
+/* CCR field width */
+#define STM32_I2C_CCR_MAX         (0xFFFU)
+
+/* Messages of at least this many bytes use DMA on adapters that have it.
+   DMA reception of a single byte cannot NACK it in time on F1 (errata),
+   so the threshold must stay at 2 or above. */
+#ifndef BSP_I2C_DMA_THRESHOLD
+    #define BSP_I2C_DMA_THRESHOLD (8U)
+#endif
+
+#if (BSP_I2C_DMA_THRESHOLD < 2)
+#error "BSP_I2C_DMA_THRESHOLD must be at least 2"
+#endif
+
+/*
+ * With DMA enabled this driver owns the channel pair and its IRQ handlers:
+ * I2C1 DMA1 channel 6/7 (shared with USART2 RX/TX), I2C2 DMA1 channel 4/5
+ * (shared with SPI2 and USART1 TX/RX). UART DMA is declared by the board
+ * with BSP_UARTx_USING_DMA.
+ */
+#if defined(BSP_I2C1_USING_DMA) && defined(BSP_UART2_USING_DMA)
+#error "BSP_I2C1_USING_DMA and BSP_UART2_USING_DMA share DMA1 channel 6/7"
+#endif
+#if defined(BSP_I2C2_USING_DMA) && defined(BSP_SPI2_USING_DMA)
+#error "BSP_I2C2_USING_DMA and BSP_SPI2_USING_DMA share DMA1 channel 4/5"
+#endif
+#if defined(BSP_I2C2_USING_DMA) && defined(BSP_UART1_USING_DMA)
+#error "BSP_I2C2_USING_DMA and BSP_UART1_USING_DMA share DMA1 channel 4/5"
+#endif
+
 /* Private macro -------------------------------------------------------------*/
 
 
@@ -87,6 +154,511 @@ enum
 
 
 
+/* Private functions ---------------------------------------------------------*/
+/**
+ * @brief Finish the sequence and wake the waiting task
+ * @param hw Hardware data
+ * @param result Sequence result
+ * @note Called from the I2C interrupt callbacks only.
+ */
+static void stm32_i2c_seq_complete(struct stm32_i2c_hw *hw, HAL_StatusTypeDef result)
+{
+#if defined(USING_FREERTOS) || defined(configUSE_MUTEXES)
+    BaseType_t woken = pdFALSE;
+#endif
+
+    hw->xfer_end   = BSP_DWT_GetTick();
+    hw->seq.result = result;
+    hw->seq.done   = 1U;
+
+#if defined(USING_FREERTOS) || defined(configUSE_MUTEXES)
+    if (hw->done_sem != NULL) {
+        (void)xSemaphoreGiveFromISR(hw->done_sem, &woken);
+        portYIELD_FROM_ISR(woken);
+    }
+#endif
+}
+
+/**
+ * @brief Block until the sequence ends or the timeout expires
+ * @param hw Hardware data
+ * @param timeout Timeout in milliseconds
+ * @return 0 on completion, -EAGAIN on timeout
+ * @note The caller sleeps on the semaphore once the scheduler runs, and in
+ *       WFI otherwise, so it consumes no CPU while the bus is busy.
+ */
+static int stm32_i2c_seq_wait(struct stm32_i2c_hw *hw, uint32_t timeout)
+{
+    uint32_t start;
+    uint32_t level;
+
+#if defined(USING_FREERTOS) || defined(configUSE_MUTEXES)
+    if ((hw->done_sem != NULL) && (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING)) {
+        TickType_t wait_start = xTaskGetTickCount();
+        TickType_t ticks = pdMS_TO_TICKS(timeout);
+        TickType_t elapsed;
+
+        /* A stale give from an earlier timed out sequence is dropped here */
+        while (hw->seq.done == 0U) {
+            elapsed = xTaskGetTickCount() - wait_start;
+            if (elapsed >= ticks) {
+                return -EAGAIN;
+            }
+            (void)xSemaphoreTake(hw->done_sem, ticks - elapsed);
+        }
+        return 0;
+    }
+#endif
+
+    start = HAL_GetTick();
+    while (hw->seq.done == 0U) {
+        if ((HAL_GetTick() - start) >= timeout) {
+            return -EAGAIN;
+        }
+        /* WFI with interrupts masked still wakes on a pending IRQ, so a
+           completion between the check and the sleep is not missed */
+        level = __get_PRIMASK();
+        __disable_irq();
+        if (hw->seq.done == 0U) {
+            __WFI();
+        }
+        __set_PRIMASK(level);
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Stop a sequence that did not finish in time
+ * @param hw Hardware data
+ * @note Re-initializing resets the peripheral (SWRST) and drops the
+ *       HAL state machine, which an abort request cannot do when SCL is
+ *       held low by a slave.
+ */
+static void stm32_i2c_seq_abort(struct stm32_i2c_hw *hw)
+{
+    uint32_t level;
+
+    level = __get_PRIMASK();
+    __disable_irq();
+    hw->seq.active = 0U;
+    __set_PRIMASK(level);
+
+    if (hw->hdma_tx.Instance != NULL) {
+        (void)HAL_DMA_Abort(&hw->hdma_tx);
+        (void)HAL_DMA_Abort(&hw->hdma_rx);
+    }
+
+    (void)HAL_I2C_DeInit(&hw->hi2c);
+    (void)HAL_I2C_Init(&hw->hi2c);
+}
+
+/**
+ * @brief Calculate the SCL rate the F1 clock control register achieves
+ * @param pclk PCLK1 frequency
+ * @param speed_hz Requested rate, at most 400 kHz
+ * @param duty Output, fast mode duty cycle to program
+ * @return Achieved rate (at most the requested one), 0 if out of range
+ * @note Mirrors the CCR rounding of HAL_I2C_Init: standard mode runs at
+ *       PCLK1 / (2 * CCR) with CCR >= 4, fast mode at PCLK1 / (3 * CCR)
+ *       (duty 2) or PCLK1 / (25 * CCR) (duty 16/9). The fast mode duty
+ *       giving the higher rate is chosen.
+ */
+static uint32_t stm32_i2c_calc_speed(uint32_t pclk, uint32_t speed_hz, uint32_t *duty)
+{
+    uint32_t ccr;
+    uint32_t rate_2;
+    uint32_t rate_16_9;
+
+    if (speed_hz <= I2C_MAX_STANDARD_MODE_FREQ) {
+        if (pclk < STM32_I2C_MIN_PCLK_SM) {
+            return 0U;
+        }
+        ccr = ((pclk - 1U) / (speed_hz * 2U)) + 1U;
+        if (ccr < 4U) {
+            ccr = 4U;
+        }
+        if (ccr > STM32_I2C_CCR_MAX) {
+            return 0U;
+        }
+        *duty = I2C_DUTYCYCLE_2;
+        return pclk / (ccr * 2U);
+    }
+
+    if (pclk < STM32_I2C_MIN_PCLK_FM) {
+        return 0U;
+    }
+
+    ccr = ((pclk - 1U) / (speed_hz * 3U)) + 1U;
+    rate_2 = pclk / (ccr * 3U);
+
+    ccr = ((pclk - 1U) / (speed_hz * 25U)) + 1U;
+    rate_16_9 = pclk / (ccr * 25U);
+
+    if (rate_16_9 > rate_2) {
+        *duty = I2C_DUTYCYCLE_16_9;
+        return rate_16_9;
+    }
+
+    *duty = I2C_DUTYCYCLE_2;
+    return rate_2;
+}
+
+/**
+ * @brief Start one message of the sequence
+ * @param hw Hardware data
+ * @param msg Message
+ * @param opt HAL sequential transfer option (I2C_FIRST_FRAME, ...)
+ * @return HAL status
+ * @note Long messages go through DMA, which takes two interrupts per
+ *       message instead of one per byte. HAL sets CR2.LAST on the final
+ *       DMA read so the last byte is NACKed.
+ */
+static HAL_StatusTypeDef stm32_i2c_seq_start(struct stm32_i2c_hw *hw, struct i2c_msg *msg, uint32_t opt)
+{
+    I2C_HandleTypeDef *hi2c = &hw->hi2c;
+    uint32_t mode;
+    uint16_t dev_addr;
+    uint8_t use_dma;
+
+    mode = ((msg->flags & I2C_M_TEN) != 0U) ?
+           I2C_ADDRESSINGMODE_10BIT : I2C_ADDRESSINGMODE_7BIT;
+    if (hi2c->Init.AddressingMode != mode) {
+        hi2c->Init.AddressingMode = mode;
+    }
+
+    dev_addr = ((msg->flags & I2C_M_TEN) != 0U) ?
+               msg->addr : (uint16_t)(msg->addr << 1U);
+
+    use_dma = (msg->len >= BSP_I2C_DMA_THRESHOLD) ? 1U : 0U;
+
+    if ((msg->flags & I2C_M_RD) != 0U) {
+        if ((use_dma != 0U) && (hw->hdma_rx.Instance != NULL)) {
+            return HAL_I2C_Master_Seq_Receive_DMA(hi2c, dev_addr, msg->buf, msg->len, opt);
+        }
+        return HAL_I2C_Master_Seq_Receive_IT(hi2c, dev_addr, msg->buf, msg->len, opt);
+    }
+
+    if ((use_dma != 0U) && (hw->hdma_tx.Instance != NULL)) {
+        return HAL_I2C_Master_Seq_Transmit_DMA(hi2c, dev_addr, msg->buf, msg->len, opt);
+    }
+    return HAL_I2C_Master_Seq_Transmit_IT(hi2c, dev_addr, msg->buf, msg->len, opt);
+}
+
+/**
+ * @brief Set up the DMA channels of an adapter
+ * @param hw Hardware data
+ * @return HAL status
+ */
+static HAL_StatusTypeDef stm32_i2c_dma_init(struct stm32_i2c_hw *hw)
+{
+    DMA_HandleTypeDef *hdma[2] = { &hw->hdma_tx, &hw->hdma_rx };
+    IRQn_Type irq[2] = { hw->dma_tx_irq, hw->dma_rx_irq };
+    uint32_t i;
+
+    if (hw->hdma_tx.Instance == NULL) {
+        return HAL_OK;
+    }
+
+    __HAL_RCC_DMA1_CLK_ENABLE();
+
+    for (i = 0U; i < 2U; i++) {
+        hdma[i]->Init.Direction           = (i == 0U) ? DMA_MEMORY_TO_PERIPH : DMA_PERIPH_TO_MEMORY;
+        hdma[i]->Init.PeriphInc           = DMA_PINC_DISABLE;
+        hdma[i]->Init.MemInc              = DMA_MINC_ENABLE;
+        hdma[i]->Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+        hdma[i]->Init.MemDataAlignment    = DMA_MDATAALIGN_BYTE;
+        hdma[i]->Init.Mode                = DMA_NORMAL;
+        hdma[i]->Init.Priority            = DMA_PRIORITY_HIGH;
+        if (HAL_DMA_Init(hdma[i]) != HAL_OK) {
+            return HAL_ERROR;
+        }
+
+        HAL_NVIC_SetPriority(irq[i], BSP_I2C_IRQ_PRIORITY, 0);
+        HAL_NVIC_EnableIRQ(irq[i]);
+    }
+
+    __HAL_LINKDMA(&hw->hi2c, hdmatx, hw->hdma_tx);
+    __HAL_LINKDMA(&hw->hi2c, hdmarx, hw->hdma_rx);
+
+    return HAL_OK;
+}
+
+/**
+ * @brief Clear the telemetry of an adapter
+ * @param hw Hardware data
+ */
+static void stm32_i2c_stats_reset(struct stm32_i2c_hw *hw)
+{
+    uint32_t level;
+
+    level = __get_PRIMASK();
+    __disable_irq();
+    memset(&hw->stats, 0, sizeof(hw->stats));
+    hw->stats.lat_min = UINT32_MAX;
+    hw->lat_sum       = 0U;
+    hw->stats_since   = HAL_GetTick();
+    __set_PRIMASK(level);
+}
+
+/**
+ * @brief Account one transaction that was put on the bus
+ * @param hw Hardware data
+ * @param msgs Messages of the transaction
+ * @param num Number of messages
+ * @param status 0 on success, error code on failure
+ * @param end DWT stamp of the completion
+ * @note Runs from the callbacks and from task context after a timeout,
+ *       so the update is done with interrupts masked.
+ */
+static void stm32_i2c_stats_xfer(struct stm32_i2c_hw *hw, const struct i2c_msg *msgs,
+                                 uint16_t num, int status, uint32_t end)
+{
+    uint32_t lat = end - hw->xfer_start;
+    uint32_t level;
+    uint16_t i;
+
+    level = __get_PRIMASK();
+    __disable_irq();
+    hw->stats.transfers++;
+    if (status == 0) {
+        for (i = 0U; i < num; i++) {
+            hw->stats.bytes += msgs[i].len;
+        }
+    } else {
+        hw->stats.errors++;
+    }
+
+    if (lat < hw->stats.lat_min) {
+        hw->stats.lat_min = lat;
+    }
+    if (lat > hw->stats.lat_max) {
+        hw->stats.lat_max = lat;
+    }
+    hw->lat_sum += lat;
+    __set_PRIMASK(level);
+}
+
+/**
+ * @brief Increment a telemetry counter
+ * @param counter Counter inside hw->stats
+ * @note For task context, where the callbacks may update the same
+ *       counter or a reset may run concurrently.
+ */
+static void stm32_i2c_stats_inc(uint32_t *counter)
+{
+    uint32_t level;
+
+    level = __get_PRIMASK();
+    __disable_irq();
+    (*counter)++;
+    __set_PRIMASK(level);
+}
+
+/**
+ * @brief Count the error classes reported by HAL
+ * @param hw Hardware data
+ * @param error_code HAL_I2C_ERROR_xxx bits
+ */
+static void stm32_i2c_stats_error(struct stm32_i2c_hw *hw, uint32_t error_code)
+{
+    if ((error_code & HAL_I2C_ERROR_BERR) != 0U) {
+        hw->stats.berr++;
+    }
+    if ((error_code & HAL_I2C_ERROR_ARLO) != 0U) {
+        hw->stats.arlo++;
+    }
+    if ((error_code & HAL_I2C_ERROR_AF) != 0U) {
+        hw->stats.af++;
+    }
+    if ((error_code & HAL_I2C_ERROR_OVR) != 0U) {
+        hw->stats.ovr++;
+    }
+    if ((error_code & HAL_I2C_ERROR_DMA) != 0U) {
+        hw->stats.dma++;
+    }
+    if ((error_code & HAL_I2C_ERROR_TIMEOUT) != 0U) {
+        hw->stats.timeout++;
+    }
+}
+
+/**
+ * @brief Take the sequential context for a new transfer
+ * @param hw Hardware data
+ * @return 0 on success, -EBUSY if a transfer or batch is in progress
+ */
+static int stm32_i2c_seq_claim(struct stm32_i2c_hw *hw)
+{
+    uint32_t level;
+    int ret = 0;
+
+    level = __get_PRIMASK();
+    __disable_irq();
+    if (hw->seq.active != 0U) {
+        ret = -EBUSY;
+    } else {
+        hw->seq.active = 1U;
+    }
+    __set_PRIMASK(level);
+
+    if (ret == 0) {
+#if defined(USING_FREERTOS) || defined(configUSE_MUTEXES)
+        if (hw->done_sem != NULL) {
+            (void)xSemaphoreTake(hw->done_sem, 0);
+        }
+#endif
+        hw->seq.groups = NULL;
+        hw->seq.idx    = 0U;
+        hw->seq.done   = 0U;
+        hw->seq.result = HAL_OK;
+    }
+
+    return ret;
+}
+
+/**
+ * @brief Take the adapter for a core transfer or a batch
+ * @param hw Hardware data
+ * @param timeout Maximum wait in milliseconds for the other owner
+ * @return 0 on success, -EBUSY if the adapter stayed in use
+ * @note Core transfers and batches queue on bus_lock once the scheduler
+ *       runs, so neither fails just because the other is on the bus.
+ */
+static int stm32_i2c_lock(struct stm32_i2c_hw *hw, uint32_t timeout)
+{
+#if defined(USING_FREERTOS) || defined(configUSE_MUTEXES)
+    uint8_t locked = 0U;
+
+    if ((hw->bus_lock != NULL) && (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING)) {
+        if (xSemaphoreTake(hw->bus_lock, pdMS_TO_TICKS(timeout)) != pdTRUE) {
+            return -EBUSY;
+        }
+        locked = 1U;
+    }
+
+    if (stm32_i2c_seq_claim(hw) != 0) {
+        if (locked != 0U) {
+            (void)xSemaphoreGive(hw->bus_lock);
+        }
+        return -EBUSY;
+    }
+#else
+    (void)timeout;
+
+    if (stm32_i2c_seq_claim(hw) != 0) {
+        return -EBUSY;
+    }
+#endif
+
+    return 0;
+}
+
+/**
+ * @brief Release the adapter taken with stm32_i2c_lock()
+ * @param hw Hardware data
+ */
+static void stm32_i2c_unlock(struct stm32_i2c_hw *hw)
+{
+    hw->seq.active = 0U;
+
+#if defined(USING_FREERTOS) || defined(configUSE_MUTEXES)
+    if ((hw->bus_lock != NULL) && (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING)) {
+        (void)xSemaphoreGive(hw->bus_lock);
+    }
+#endif
+}
+
+/**
+ * @brief Wait for the STOP of the previous transaction to leave the bus
+ * @param hw Hardware data
+ * @return 0 once BUSY is clear, -EAGAIN if it stays set
+ * @note The STOP completes within an SCL period or two. HAL's own BUSY
+ *       wait before a FIRST_FRAME start spins for up to 25 ms, which must
+ *       not happen from the completion interrupt.
+ */
+static int stm32_i2c_wait_idle(struct stm32_i2c_hw *hw)
+{
+    uint32_t start = BSP_DWT_GetTick();
+    uint32_t budget;
+
+    /* Four SCL periods plus interrupt latency */
+    budget = ((hw->speed_hz != 0U) ? ((SystemCoreClock / hw->speed_hz) * 4U) : 0U) +
+             (SystemCoreClock / 100000U);
+    while ((hw->hi2c.Instance->SR2 & I2C_SR2_BUSY) != 0U) {
+        if ((BSP_DWT_GetTick() - start) > budget) {
+            return -EAGAIN;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Start the first message of seq.msgs
+ * @param hw Hardware data
+ * @return HAL status
+ */
+static HAL_StatusTypeDef stm32_i2c_seq_begin(struct stm32_i2c_hw *hw)
+{
+    uint32_t opt;
+
+    hw->seq.idx = 0U;
+    opt = (hw->seq.num == 1U) ? I2C_FIRST_AND_LAST_FRAME : I2C_FIRST_FRAME;
+
+    return stm32_i2c_seq_start(hw, &hw->seq.msgs[0], opt);
+}
+
+/**
+ * @brief Start the current batch group, skipping groups that fail to start
+ * @param hw Hardware data
+ * @return 1 if a group was started, 0 if the batch is over
+ */
+static uint8_t stm32_i2c_batch_start(struct stm32_i2c_hw *hw)
+{
+    struct bsp_i2c_group *group;
+
+    while (hw->seq.group_idx < hw->seq.group_num) {
+        group = &hw->seq.groups[hw->seq.group_idx];
+        hw->seq.msgs = group->msgs;
+        hw->seq.num  = group->num;
+        hw->xfer_start = BSP_DWT_GetTick();
+        if (stm32_i2c_seq_begin(hw) == HAL_OK) {
+            return 1U;
+        }
+        group->status = -EIO;
+        stm32_i2c_stats_inc(&hw->stats.errors);
+        hw->seq.group_idx++;
+    }
+
+    return 0U;
+}
+
+/**
+ * @brief Close the current batch group and chain the next one
+ * @param hw Hardware data
+ * @param status Group status
+ * @note Called from the I2C interrupt callbacks only. The last group
+ *       completes the whole batch.
+ */
+static void stm32_i2c_batch_next(struct stm32_i2c_hw *hw, int status)
+{
+    struct bsp_i2c_group *group = &hw->seq.groups[hw->seq.group_idx];
+
+    stm32_i2c_stats_xfer(hw, group->msgs, group->num, status, BSP_DWT_GetTick());
+    group->status = status;
+    hw->seq.group_idx++;
+
+    /* Bus still held (clock stretching, another master): the rest of the
+       batch keeps its -EAGAIN instead of spinning in HAL from here */
+    if ((hw->seq.group_idx < hw->seq.group_num) && (stm32_i2c_wait_idle(hw) != 0)) {
+        hw->seq.group_idx = hw->seq.group_num;
+    }
+
+    if (stm32_i2c_batch_start(hw) == 0U) {
+        stm32_i2c_seq_complete(hw, HAL_OK);
+    }
+}
+
 /* Exported functions --------------------------------------------------------*/
 /**
  * @brief HAL I2C MSP Initialization
@@ -112,9 +684,9 @@ void HAL_I2C_MspInit(I2C_HandleTypeDef *hi2c)
         __HAL_RCC_I2C1_CLK_ENABLE();
 
         /* I2C1 interrupt Init: event and error */
-        HAL_NVIC_SetPriority(I2C1_EV_IRQn, 0, 0);
+        HAL_NVIC_SetPriority(I2C1_EV_IRQn, BSP_I2C_IRQ_PRIORITY, 0);
         HAL_NVIC_EnableIRQ(I2C1_EV_IRQn);
-        HAL_NVIC_SetPriority(I2C1_ER_IRQn, 0, 0);
+        HAL_NVIC_SetPriority(I2C1_ER_IRQn, BSP_I2C_IRQ_PRIORITY, 0);
         HAL_NVIC_EnableIRQ(I2C1_ER_IRQn);
     }
 #endif /* BSP_USING_I2C1 */
@@ -134,9 +706,9 @@ void HAL_I2C_MspInit(I2C_HandleTypeDef *hi2c)
         __HAL_RCC_I2C2_CLK_ENABLE();
 
         /* I2C2 interrupt Init: event and error */
-        HAL_NVIC_SetPriority(I2C2_EV_IRQn, 0, 0);
+        HAL_NVIC_SetPriority(I2C2_EV_IRQn, BSP_I2C_IRQ_PRIORITY, 0);
         HAL_NVIC_EnableIRQ(I2C2_EV_IRQn);
-        HAL_NVIC_SetPriority(I2C2_ER_IRQn, 0, 0);
+        HAL_NVIC_SetPriority(I2C2_ER_IRQn, BSP_I2C_IRQ_PRIORITY, 0);
         HAL_NVIC_EnableIRQ(I2C2_ER_IRQn);
     }
 #endif /* BSP_USING_I2C2 */
@@ -178,11 +750,8 @@ static int stm32_i2c_master_xfer(struct i2c_adapter *adap, struct i2c_msg *msgs,
 {
     struct stm32_i2c_hw *hw = NULL;
     I2C_HandleTypeDef *hi2c = NULL;
-    struct i2c_msg *msg = NULL;
-    uint32_t new_addressing_mode;
-    uint16_t dev_addr;
-    uint32_t xfer_opt;
     HAL_StatusTypeDef hal_status;
+    int ret;
 
     if ((adap == NULL) || (msgs == NULL) || (num == 0U)) {
         return -EINVAL;
@@ -196,72 +765,60 @@ static int stm32_i2c_master_xfer(struct i2c_adapter *adap, struct i2c_msg *msgs,
 
     hi2c = &hw->hi2c;
 
-    /* Initialize sequential context */
-    hw->seq.msgs   = msgs;
-    hw->seq.num    = num;
-    hw->seq.idx    = 0U;
-    hw->seq.done   = 0U;
-    hw->seq.result = HAL_OK;
-    hw->seq.active = 1U;
-
-    /* Configure first message */
-    msg = &msgs[0];
-    new_addressing_mode = ((msg->flags & I2C_M_TEN) != 0U) ?
-                           I2C_ADDRESSINGMODE_10BIT : I2C_ADDRESSINGMODE_7BIT;
-    if (hi2c->Init.AddressingMode != new_addressing_mode) {
-        hi2c->Init.AddressingMode = new_addressing_mode;
-    }
-
-    dev_addr = ((msg->flags & I2C_M_TEN) != 0U) ?
-               msg->addr : (uint16_t)(msg->addr << 1U);
-
-    if (num == 1U) {
-        xfer_opt = I2C_FIRST_AND_LAST_FRAME;
-    } else {
-        xfer_opt = I2C_FIRST_FRAME;
+    /* Initialize sequential context, waiting out a batch on the bus */
+    if (stm32_i2c_lock(hw, (uint32_t)adap->timeout) != 0) {
+        return -EBUSY;
     }
+    hw->seq.msgs = msgs;
+    hw->seq.num  = num;
 
-    if ((msg->flags & I2C_M_RD) != 0U) {
-        hal_status = HAL_I2C_Master_Seq_Receive_IT(hi2c,
-                                                   dev_addr,
-                                                   msg->buf,
-                                                   msg->len,
-                                                   xfer_opt);
-    } else {
-        hal_status = HAL_I2C_Master_Seq_Transmit_IT(hi2c,
-                                                    dev_addr,
-                                                    msg->buf,
-                                                    msg->len,
-                                                    xfer_opt);
-    }
+    /* Start first message */
+    hw->xfer_start = BSP_DWT_GetTick();
+    hal_status = stm32_i2c_seq_begin(hw);
 
     if (hal_status != HAL_OK) {
-        hw->seq.active = 0U;
+        stm32_i2c_unlock(hw);
+        stm32_i2c_stats_inc(&hw->stats.errors);
         LOG_E("I2C seq start failed, status=%d", (int)hal_status);
         return -EIO;
     }
 
     /* Wait for sequential transfer completion driven by callbacks */
-    while (hw->seq.done == 0U) {
-#if defined(USING_FREERTOS) || defined(configUSE_MUTEXES)
-        taskYIELD();
-#endif
+    if (stm32_i2c_seq_wait(hw, (uint32_t)adap->timeout) != 0) {
+        stm32_i2c_seq_abort(hw);
+        if (hw->seq.done == 0U) {
+            LOG_E("%s transfer timeout, msg %u/%u", adap->name,
+                  (unsigned)hw->seq.idx, (unsigned)num);
+            stm32_i2c_stats_inc(&hw->stats.timeout);
+            stm32_i2c_stats_xfer(hw, msgs, num, -EAGAIN, BSP_DWT_GetTick());
+            stm32_i2c_unlock(hw);
+            return -EAGAIN;
+        }
     }
 
-    hw->seq.active = 0U;
+    /* Everything read from the context is consumed before the adapter is
+       released, a waiting batch resets it as soon as it gets the lock */
+    ret = 0;
     
     if (hi2c->ErrorCode != HAL_I2C_ERROR_NONE) {
         if (hi2c->ErrorCode & HAL_I2C_ERROR_ARLO || hi2c->ErrorCode & HAL_I2C_ERROR_TIMEOUT) {
-            return -EAGAIN;
+            ret = -EAGAIN;
         }
     }
     
-    if (hw->seq.result != HAL_OK) {
-        LOG_E("I2C sequential transfer failed, status=%d", (int)hw->seq.result);
-        return -EIO;
+    hal_status = hw->seq.result;
+    if ((ret == 0) && (hal_status != HAL_OK)) {
+        ret = -EIO;
+    }
+
+    stm32_i2c_stats_xfer(hw, msgs, num, ret, hw->xfer_end);
+    stm32_i2c_unlock(hw);
+
+    if (ret == -EIO) {
+        LOG_E("I2C sequential transfer failed, status=%d", (int)hal_status);
     }
 
-    return (int)num;
+    return (ret != 0) ? ret : (int)num;
 }
 
 /**
@@ -276,6 +833,7 @@ static void stm32_i2c_prepare_recovery(struct i2c_adapter *adap)
         return;
     }
 
+    stm32_i2c_stats_inc(&hw->stats.recoveries);
     (void)HAL_I2C_DeInit(&hw->hi2c);
 }
 
@@ -306,11 +864,23 @@ static struct stm32_i2c_hw stm32_i2c_hw[I2C_INDEX_MAX] = {
 #ifdef BSP_USING_I2C1
     {
         .hi2c.Instance = I2C1,
+#ifdef BSP_I2C1_USING_DMA
+        .hdma_tx.Instance = DMA1_Channel6,
+        .hdma_rx.Instance = DMA1_Channel7,
+        .dma_tx_irq = DMA1_Channel6_IRQn,
+        .dma_rx_irq = DMA1_Channel7_IRQn,
+#endif
     },
 #endif
 #ifdef BSP_USING_I2C2
     {
         .hi2c.Instance = I2C2,
+#ifdef BSP_I2C2_USING_DMA
+        .hdma_tx.Instance = DMA1_Channel4,
+        .hdma_rx.Instance = DMA1_Channel5,
+        .dma_tx_irq = DMA1_Channel4_IRQn,
+        .dma_rx_irq = DMA1_Channel5_IRQn,
+#endif
     },
 #endif
 };
@@ -350,12 +920,38 @@ static struct i2c_bus_recovery_info stm32_i2c_recovery[I2C_INDEX_MAX] = {
 
 /* Private functions ---------------------------------------------------------*/
 
+/**
+ * @brief Find the hardware data of an adapter by name
+ * @param bus Adapter name ("i2c1", ...)
+ * @return Hardware data, NULL if not found
+ */
+static struct stm32_i2c_hw *stm32_i2c_find(const char *bus)
+{
+    uint32_t i;
+
+    if (bus == NULL) {
+        return NULL;
+    }
+
+    for (i = 0U; i < (uint32_t)I2C_INDEX_MAX; i++) {
+        if (strcmp(stm32_i2c_adapter[i].name, bus) == 0) {
+            return &stm32_i2c_hw[i];
+        }
+    }
+
+    return NULL;
+}
+
 int bsp_i2c_init(void)
 {
     int ret = 0;
     struct stm32_i2c_hw *hw = NULL;
     struct i2c_adapter *adap = NULL;
     HAL_StatusTypeDef hal_status = HAL_OK;
+    uint32_t duty = I2C_DUTYCYCLE_2;
+    
+    /* Latency telemetry runs on the DWT cycle counter */
+    BSP_DWT_Init();
     
     for (uint32_t i = 0; i < I2C_INDEX_MAX; i++)
     {
@@ -367,6 +963,11 @@ int bsp_i2c_init(void)
         hw->seq.done   = 0U;
         hw->seq.active = 0U;
         hw->seq.result = HAL_OK;
+        hw->seq.groups = NULL;
+#if defined(USING_FREERTOS) || defined(configUSE_MUTEXES)
+        hw->done_sem = xSemaphoreCreateBinaryStatic(&hw->done_sem_buf);
+        hw->bus_lock = xSemaphoreCreateMutexStatic(&hw->bus_lock_buf);
+#endif
         
         adap = &stm32_i2c_adapter[i];
         adap->algo    = &stm32_i2c_algo;
@@ -377,10 +978,19 @@ int bsp_i2c_init(void)
         
         /* Recovery bus */
         i2c_recovery_bus(adap);
+        stm32_i2c_stats_reset(hw);
+
+        hw->speed_hz = stm32_i2c_calc_speed(HAL_RCC_GetPCLK1Freq(),
+                                            BSP_I2C_DEFAULT_SPEED_HZ, &duty);
+        if (hw->speed_hz == 0U) {
+            LOG_E("%s: %lu Hz not reachable from PCLK1", adap->name,
+                  (unsigned long)BSP_I2C_DEFAULT_SPEED_HZ);
+            return -EINVAL;
+        }
 
         /* Configure I2C initialization structure */
-        hw->hi2c.Init.ClockSpeed      = I2C_MAX_STANDARD_MODE_FREQ;
-        hw->hi2c.Init.DutyCycle       = I2C_DUTYCYCLE_16_9;
+        hw->hi2c.Init.ClockSpeed      = BSP_I2C_DEFAULT_SPEED_HZ;
+        hw->hi2c.Init.DutyCycle       = duty;
         hw->hi2c.Init.OwnAddress1     = 0U;
         hw->hi2c.Init.AddressingMode  = I2C_ADDRESSINGMODE_7BIT;
         hw->hi2c.Init.DualAddressMode = I2C_DUALADDRESS_DISABLE;
@@ -393,6 +1003,11 @@ int bsp_i2c_init(void)
             LOG_E("Failed to initialize: HAL status %d", hal_status);
             return -EIO;
         }
+
+        if (stm32_i2c_dma_init(hw) != HAL_OK) {
+            LOG_E("Failed to initialize %s DMA", adap->name);
+            return -EIO;
+        }
 #ifdef I2C_FLTR_DNF
         /** Configure Analogue filter
         */
@@ -414,12 +1029,191 @@ int bsp_i2c_init(void)
             return -EIO;
         }
         
-        LOG_I("I2C adapter %s registered, speed: %lu Hz", adap->name, hw->hi2c.Init.ClockSpeed);
+        LOG_I("I2C adapter %s registered, speed: %lu Hz", adap->name, hw->speed_hz);
     }
     
     return 0;
 }
 
+int bsp_i2c_set_speed(const char *bus, uint32_t speed_hz, uint32_t *actual_hz)
+{
+    struct stm32_i2c_hw *hw;
+    uint32_t duty = I2C_DUTYCYCLE_2;
+    uint32_t actual;
+
+    hw = stm32_i2c_find(bus);
+    if (hw == NULL) {
+        return -ENODEV;
+    }
+
+    if (speed_hz == 0U) {
+        return -EINVAL;
+    }
+
+    /* F1 I2C stops at fast mode, there is no Fast-mode Plus driver stage */
+    if (speed_hz > I2C_MAX_FAST_MODE_FREQ) {
+        LOG_W("%s: %lu Hz needs Fast-mode Plus, not supported", bus, speed_hz);
+        return -EINVAL;
+    }
+
+    actual = stm32_i2c_calc_speed(HAL_RCC_GetPCLK1Freq(), speed_hz, &duty);
+    if (actual == 0U) {
+        return -EINVAL;
+    }
+
+    /* Hold the adapter across the re-init so no transfer starts under it */
+    if (stm32_i2c_lock(hw, (uint32_t)stm32_i2c_adapter[hw - stm32_i2c_hw].timeout) != 0) {
+        return -EBUSY;
+    }
+    if (hw->hi2c.State != HAL_I2C_STATE_READY) {
+        stm32_i2c_unlock(hw);
+        return -EBUSY;
+    }
+
+    /* HAL_I2C_Init recomputes CCR and TRISE from ClockSpeed/DutyCycle */
+    hw->hi2c.Init.ClockSpeed = speed_hz;
+    hw->hi2c.Init.DutyCycle  = duty;
+    if (HAL_I2C_Init(&hw->hi2c) != HAL_OK) {
+        stm32_i2c_unlock(hw);
+        LOG_E("%s: re-init at %lu Hz failed", bus, speed_hz);
+        return -EIO;
+    }
+
+    hw->speed_hz = actual;
+    stm32_i2c_unlock(hw);
+    if (actual_hz != NULL) {
+        *actual_hz = actual;
+    }
+
+    return 0;
+}
+
+int bsp_i2c_get_speed(const char *bus, uint32_t *actual_hz)
+{
+    struct stm32_i2c_hw *hw;
+
+    hw = stm32_i2c_find(bus);
+    if ((hw == NULL) || (actual_hz == NULL)) {
+        return (hw == NULL) ? -ENODEV : -EINVAL;
+    }
+
+    *actual_hz = hw->speed_hz;
+
+    return 0;
+}
+
+int bsp_i2c_transfer_batch(const char *bus, struct bsp_i2c_group *groups, uint16_t num)
+{
+    struct stm32_i2c_hw *hw;
+    uint32_t timeout;
+    uint16_t i;
+    int ok = 0;
+
+    hw = stm32_i2c_find(bus);
+    if (hw == NULL) {
+        return -ENODEV;
+    }
+
+    if ((groups == NULL) || (num == 0U)) {
+        return -EINVAL;
+    }
+
+    for (i = 0U; i < num; i++) {
+        if ((groups[i].msgs == NULL) || (groups[i].num == 0U)) {
+            return -EINVAL;
+        }
+        /* Groups still pending when the batch times out keep this */
+        groups[i].status = -EAGAIN;
+    }
+
+    timeout = (uint32_t)stm32_i2c_adapter[hw - stm32_i2c_hw].timeout;
+    if (stm32_i2c_lock(hw, timeout) != 0) {
+        return -EBUSY;
+    }
+    hw->seq.groups    = groups;
+    hw->seq.group_num = num;
+    hw->seq.group_idx = 0U;
+
+    if (stm32_i2c_batch_start(hw) == 0U) {
+        /* Every group failed to start, nothing is on the bus */
+        stm32_i2c_unlock(hw);
+        return 0;
+    }
+
+    /* Each group gets the budget of an individual transfer */
+    timeout *= num;
+    if (stm32_i2c_seq_wait(hw, timeout) != 0) {
+        stm32_i2c_seq_abort(hw);
+        if (hw->seq.done == 0U) {
+            LOG_E("%s batch timeout, group %u/%u", bus,
+                  (unsigned)hw->seq.group_idx, (unsigned)num);
+            stm32_i2c_stats_inc(&hw->stats.timeout);
+            if (hw->seq.group_idx < num) {
+                stm32_i2c_stats_xfer(hw, groups[hw->seq.group_idx].msgs,
+                                     groups[hw->seq.group_idx].num, -EAGAIN,
+                                     BSP_DWT_GetTick());
+            }
+        }
+    }
+
+    stm32_i2c_unlock(hw);
+
+    for (i = 0U; i < num; i++) {
+        if (groups[i].status == 0) {
+            ok++;
+        }
+    }
+
+    return ok;
+}
+
+int bsp_i2c_get_stats(const char *bus, struct bsp_i2c_stats *stats)
+{
+    struct stm32_i2c_hw *hw;
+    uint64_t lat_sum;
+    uint64_t window;
+    uint32_t level;
+
+    hw = stm32_i2c_find(bus);
+    if ((hw == NULL) || (stats == NULL)) {
+        return (hw == NULL) ? -ENODEV : -EINVAL;
+    }
+
+    level = __get_PRIMASK();
+    __disable_irq();
+    *stats  = hw->stats;
+    lat_sum = hw->lat_sum;
+    window  = (uint64_t)(HAL_GetTick() - hw->stats_since) * (SystemCoreClock / 1000U);
+    __set_PRIMASK(level);
+
+    if (stats->transfers == 0U) {
+        stats->lat_min = 0U;
+    } else {
+        stats->lat_avg = (uint32_t)(lat_sum / stats->transfers);
+    }
+
+    if (window != 0U) {
+        lat_sum = (lat_sum * 1000U) / window;
+        stats->busy_permille = (lat_sum > 1000U) ? 1000U : (uint32_t)lat_sum;
+    }
+
+    return 0;
+}
+
+int bsp_i2c_reset_stats(const char *bus)
+{
+    struct stm32_i2c_hw *hw;
+
+    hw = stm32_i2c_find(bus);
+    if (hw == NULL) {
+        return -ENODEV;
+    }
+
+    stm32_i2c_stats_reset(hw);
+
+    return 0;
+}
+
 /**
   * @brief  I2C error callback.
   * @param  hi2c Pointer to a I2C_HandleTypeDef structure that contains
@@ -435,9 +1229,16 @@ void HAL_I2C_ErrorCallback(I2C_HandleTypeDef *hi2c)
     /* Update sequential context if any */
     for (i = 0U; i < (uint32_t)I2C_INDEX_MAX; i++) {
         if (hi2c == &stm32_i2c_hw[i].hi2c) {
+            stm32_i2c_stats_error(&stm32_i2c_hw[i], hi2c->ErrorCode);
             if (stm32_i2c_hw[i].seq.active != 0U) {
-                stm32_i2c_hw[i].seq.result = HAL_ERROR;
-                stm32_i2c_hw[i].seq.done   = 1U;
+                if (stm32_i2c_hw[i].seq.groups != NULL) {
+                    /* A failed group does not stop the rest of the batch */
+                    stm32_i2c_batch_next(&stm32_i2c_hw[i],
+                        ((hi2c->ErrorCode & (HAL_I2C_ERROR_ARLO | HAL_I2C_ERROR_TIMEOUT)) != 0U) ?
+                        -EAGAIN : -EIO);
+                } else {
+                    stm32_i2c_seq_complete(&stm32_i2c_hw[i], HAL_ERROR);
+                }
             }
             break;
         }
@@ -504,11 +1305,11 @@ void I2C1_ER_IRQHandler(void)
 
 #ifdef BSP_USING_I2C2
 /**
-  * @brief This function handles I2C1 event interrupt.
+  * @brief This function handles I2C2 event interrupt.
   */
 void I2C2_EV_IRQHandler(void)
 {
-    HAL_I2C_EV_IRQHandler(&stm32_i2c_hw[I2C1_INDEX].hi2c);
+    HAL_I2C_EV_IRQHandler(&stm32_i2c_hw[I2C2_INDEX].hi2c);
 }
 
 /**
@@ -520,6 +1321,42 @@ void I2C2_ER_IRQHandler(void)
 }
 #endif
 
+#ifdef BSP_I2C1_USING_DMA
+/**
+  * @brief This function handles I2C1 TX DMA interrupt (DMA1 channel 6).
+  */
+void DMA1_Channel6_IRQHandler(void)
+{
+    HAL_DMA_IRQHandler(&stm32_i2c_hw[I2C1_INDEX].hdma_tx);
+}
+
+/**
+  * @brief This function handles I2C1 RX DMA interrupt (DMA1 channel 7).
+  */
+void DMA1_Channel7_IRQHandler(void)
+{
+    HAL_DMA_IRQHandler(&stm32_i2c_hw[I2C1_INDEX].hdma_rx);
+}
+#endif
+
+#ifdef BSP_I2C2_USING_DMA
+/**
+  * @brief This function handles I2C2 TX DMA interrupt (DMA1 channel 4).
+  */
+void DMA1_Channel4_IRQHandler(void)
+{
+    HAL_DMA_IRQHandler(&stm32_i2c_hw[I2C2_INDEX].hdma_tx);
+}
+
+/**
+  * @brief This function handles I2C2 RX DMA interrupt (DMA1 channel 5).
+  */
+void DMA1_Channel5_IRQHandler(void)
+{
+    HAL_DMA_IRQHandler(&stm32_i2c_hw[I2C2_INDEX].hdma_rx);
+}
+#endif
+
 /**
   * @brief  Master Tx Transfer completed callback.
   * @param  hi2c Pointer to a I2C handle structure that contains
@@ -535,53 +1372,33 @@ void HAL_I2C_MasterTxCpltCallback(I2C_HandleTypeDef *hi2c)
 
         if (hi2c == &hw->hi2c) {
             if ((hw->seq.active != 0U) && (hw->seq.done == 0U)) {
-                struct i2c_msg *msg;
-                uint32_t mode;
-                uint16_t dev_addr;
                 uint32_t opt;
                 HAL_StatusTypeDef status;
 
                 hw->seq.idx++;
                 if (hw->seq.idx >= hw->seq.num) {
-                    hw->seq.result = HAL_OK;
-                    hw->seq.done   = 1U;
+                    if (hw->seq.groups != NULL) {
+                        stm32_i2c_batch_next(hw, 0);
+                    } else {
+                        stm32_i2c_seq_complete(hw, HAL_OK);
+                    }
                     return;
                 }
 
-                msg = &hw->seq.msgs[hw->seq.idx];
-
-                mode = ((msg->flags & I2C_M_TEN) != 0U) ?
-                       I2C_ADDRESSINGMODE_10BIT : I2C_ADDRESSINGMODE_7BIT;
-                if (hi2c->Init.AddressingMode != mode) {
-                    hi2c->Init.AddressingMode = mode;
-                }
-
-                dev_addr = ((msg->flags & I2C_M_TEN) != 0U) ?
-                           msg->addr : (uint16_t)(msg->addr << 1U);
-
                 if (hw->seq.idx == (uint16_t)(hw->seq.num - 1U)) {
                     opt = I2C_LAST_FRAME;
                 } else {
                     opt = I2C_NEXT_FRAME;
                 }
 
-                if ((msg->flags & I2C_M_RD) != 0U) {
-                    status = HAL_I2C_Master_Seq_Receive_IT(hi2c,
-                                                           dev_addr,
-                                                           msg->buf,
-                                                           msg->len,
-                                                           opt);
-                } else {
-                    status = HAL_I2C_Master_Seq_Transmit_IT(hi2c,
-                                                            dev_addr,
-                                                            msg->buf,
-                                                            msg->len,
-                                                            opt);
-                }
+                status = stm32_i2c_seq_start(hw, &hw->seq.msgs[hw->seq.idx], opt);
 
                 if (status != HAL_OK) {
-                    hw->seq.result = status;
-                    hw->seq.done   = 1U;
+                    if (hw->seq.groups != NULL) {
+                        stm32_i2c_batch_next(hw, -EIO);
+                    } else {
+                        stm32_i2c_seq_complete(hw, status);
+                    }
                 }
             }
             return;
@@ -25,6 +25,37 @@
 
 /* Exported types ------------------------------------------------------------*/
 
+/**
+ * @brief One independent transaction of a batch
+ * @note The messages are run as one combined transaction (repeated start
+ *       between them, stop at the end), like a single i2c transfer.
+ */
+struct bsp_i2c_group {
+    struct i2c_msg *msgs;            /**< Messages */
+    uint16_t num;                    /**< Number of messages */
+    int status;                      /**< Filled in: 0 on success, error code on failure */
+};
+
+/**
+ * @brief Per-adapter telemetry, counted since init or the last reset
+ */
+struct bsp_i2c_stats {
+    uint32_t transfers;              /**< Transactions put on the bus (core transfers and batch groups) */
+    uint32_t bytes;                  /**< Payload bytes of successful transactions */
+    uint32_t errors;                 /**< Failed transactions, including failed starts */
+    uint32_t berr;                   /**< Bus errors */
+    uint32_t arlo;                   /**< Arbitration losses */
+    uint32_t af;                     /**< Acknowledge failures */
+    uint32_t ovr;                    /**< Overruns/underruns */
+    uint32_t dma;                    /**< DMA errors */
+    uint32_t timeout;                /**< HAL timeouts and missed transfer deadlines */
+    uint32_t recoveries;             /**< Bus recoveries run by the i2c core */
+    uint32_t lat_min;                /**< Shortest transaction, DWT cycles */
+    uint32_t lat_avg;                /**< Average transaction, DWT cycles */
+    uint32_t lat_max;                /**< Longest transaction, DWT cycles */
+    uint32_t busy_permille;          /**< Share of time with a transaction in flight, 0.1 % units */
+};
+
 /* Exported constants --------------------------------------------------------*/
 
 /* Exported macros -----------------------------------------------------------*/
@@ -39,6 +70,62 @@
  */
 int bsp_i2c_init(void);
 
+/**
+ * @brief Change the SCL rate of an adapter
+ * @param bus Adapter name ("i2c1", ...)
+ * @param speed_hz Requested rate, at most 400 kHz (no Fast-mode Plus on F1)
+ * @param actual_hz Output, achieved rate (at most the requested one), may be NULL
+ * @return 0 on success, -EBUSY if a transfer still holds the adapter
+ *         after the adapter timeout, error code on failure
+ * @note Standard mode up to 100 kHz, fast mode above. The rate is derived
+ *       from the current PCLK1, so call it again after a clock change.
+ */
+int bsp_i2c_set_speed(const char *bus, uint32_t speed_hz, uint32_t *actual_hz);
+
+/**
+ * @brief Report the SCL rate of an adapter
+ * @param bus Adapter name ("i2c1", ...)
+ * @param actual_hz Output, achieved rate
+ * @return 0 on success, error code on failure
+ */
+int bsp_i2c_get_speed(const char *bus, uint32_t *actual_hz);
+
+/**
+ * @brief Run independent transactions back to back
+ * @param bus Adapter name ("i2c1", ...)
+ * @param groups Transactions, possibly to different addresses
+ * @param num Number of groups
+ * @return Number of groups that succeeded (0 when none did, see each
+ *         group status), error code when the batch could not run at all
+ * @note The next group is started from the completion interrupt of the
+ *       previous one, and the caller is woken once for the whole batch.
+ *       A failing group does not stop the others; see each group status.
+ *       Groups cut off by the timeout (adapter timeout per group), or not
+ *       started because the bus stayed busy after the previous STOP,
+ *       report -EAGAIN. The batch holds the adapter like a core transfer,
+ *       so the two wait for each other. This bypasses the i2c core, so no
+ *       retries or bus recovery.
+ */
+int bsp_i2c_transfer_batch(const char *bus, struct bsp_i2c_group *groups, uint16_t num);
+
+/**
+ * @brief Read the telemetry of an adapter
+ * @param bus Adapter name ("i2c1", ...)
+ * @param stats Output
+ * @return 0 on success, error code on failure
+ * @note Latency runs from the start of a transaction to its completion
+ *       interrupt, and busy_permille is the sum of those over the time
+ *       since the last reset.
+ */
+int bsp_i2c_get_stats(const char *bus, struct bsp_i2c_stats *stats);
+
+/**
+ * @brief Clear the telemetry of an adapter
+ * @param bus Adapter name ("i2c1", ...)
+ * @return 0 on success, error code on failure
+ */
+int bsp_i2c_reset_stats(const char *bus);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
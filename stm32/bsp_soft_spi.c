@@ -0,0 +1,361 @@
+/**
+  ******************************************************************************
+  * @file        : bsp_soft_spi.c
+  * @author      : ZJY
+  * @version     : V1.0
+  * @date        : 2025-01-XX
+  * @brief       : Bit-banged SPI controller
+  * @attention   : Edges are written straight to BSRR and MISO is sampled
+  *                from IDR. Each CPOL/CPHA/bit-order combination has its
+  *                own fully unrolled kernel, picked once in setup.
+  ******************************************************************************
+  * @history     :
+  *         V1.0 : 1. Mode-specialized kernels on direct BSRR/IDR access
+  *                2. Registered through the SPI framework interface
+  *
+  ******************************************************************************
+  */
+/* Includes ------------------------------------------------------------------*/
+#include "bsp_soft_spi.h"
+#include "gpio.h"
+#include "errno-base.h"
+#include "bsp_conf.h"
+#include "bsp_dwt.h"
+#include "system_stm32f1xx.h"  /* For SystemCoreClock */
+
+#define  LOG_TAG             "bsp_soft_spi"
+#define  LOG_LVL             4
+#include "log.h"
+
+/* Private typedef -----------------------------------------------------------*/
+
+#if defined(BSP_USING_SOFT_SPI1) || defined(BSP_USING_SOFT_SPI2)
+
+struct soft_spi_hw;
+
+/**
+ * @brief Transfer kernel, one per SPI mode
+ */
+typedef void (*soft_spi_kernel_t)(const struct soft_spi_hw *hw, const uint8_t *tx_buf,
+                                  uint8_t *rx_buf, size_t len);
+
+/**
+ * @brief Bit-banged SPI hardware data structure
+ */
+struct soft_spi_hw {
+    GPIO_TypeDef *sck_port;          /**< SCK port */
+    uint32_t sck_pin;                /**< SCK pin (LL_GPIO_PIN_x) */
+    GPIO_TypeDef *mosi_port;         /**< MOSI port */
+    uint32_t mosi_pin;               /**< MOSI pin (LL_GPIO_PIN_x) */
+    GPIO_TypeDef *miso_port;         /**< MISO port */
+    uint32_t miso_pin;               /**< MISO pin (LL_GPIO_PIN_x) */
+    uint32_t sck_mask;               /**< SCK bit in BSRR */
+    uint32_t mosi_mask;              /**< MOSI bit in BSRR */
+    uint32_t miso_mask;              /**< MISO bit in IDR */
+    uint32_t half_cycles;            /**< Half SCK period in CPU cycles, 0 = as fast as possible */
+    soft_spi_kernel_t kernel;        /**< Kernel of the programmed mode */
+    const char *name;                /**< Controller name */
+};
+
+enum
+{
+#ifdef BSP_USING_SOFT_SPI1
+    SOFT_SPI1_INDEX,
+#endif
+#ifdef BSP_USING_SOFT_SPI2
+    SOFT_SPI2_INDEX,
+#endif
+    SOFT_SPI_INDEX_MAX
+};
+
+/* Private define ------------------------------------------------------------*/
+
+/* CPU cycles one unrolled half period costs without delay (edge write,
+ * MOSI write or IDR sample, loop-free). Used to report the achieved rate. */
+#ifndef BSP_SOFT_SPI_EDGE_CYCLES
+    #define BSP_SOFT_SPI_EDGE_CYCLES    (6U)
+#endif
+
+/* LL pin value to the 16-bit pin mask (F1 LL keeps CRL/CRH info in the low bits) */
+#define SOFT_SPI_PIN_MASK(pin)          (((pin) >> GPIO_PIN_MASK_POS) & 0x0000FFFFU)
+
+/* Private variables ---------------------------------------------------------*/
+static struct soft_spi_hw soft_spi_hw[SOFT_SPI_INDEX_MAX] = {
+#ifdef BSP_USING_SOFT_SPI1
+    {
+        .sck_port  = BSP_SOFT_SPI1_SCK_PORT,
+        .sck_pin   = BSP_SOFT_SPI1_SCK_PIN,
+        .mosi_port = BSP_SOFT_SPI1_MOSI_PORT,
+        .mosi_pin  = BSP_SOFT_SPI1_MOSI_PIN,
+        .miso_port = BSP_SOFT_SPI1_MISO_PORT,
+        .miso_pin  = BSP_SOFT_SPI1_MISO_PIN,
+        .name = "soft_spi1"
+    },
+#endif
+#ifdef BSP_USING_SOFT_SPI2
+    {
+        .sck_port  = BSP_SOFT_SPI2_SCK_PORT,
+        .sck_pin   = BSP_SOFT_SPI2_SCK_PIN,
+        .mosi_port = BSP_SOFT_SPI2_MOSI_PORT,
+        .mosi_pin  = BSP_SOFT_SPI2_MOSI_PIN,
+        .miso_port = BSP_SOFT_SPI2_MISO_PORT,
+        .miso_pin  = BSP_SOFT_SPI2_MISO_PIN,
+        .name = "soft_spi2"
+    },
+#endif
+};
+
+static struct spi_controller soft_spi_controller[sizeof(soft_spi_hw) / sizeof(soft_spi_hw[0])];
+
+/* Private function prototypes -----------------------------------------------*/
+static int soft_spi_setup(struct spi_controller *ctrl, struct spi_device *dev);
+static void soft_spi_set_cs(struct spi_controller *ctrl, struct spi_device *dev, uint8_t enable);
+static ssize_t soft_spi_transfer_one(struct spi_controller *ctrl,
+                                     struct spi_device *dev,
+                                     struct spi_transfer *transfer);
+
+/* Private functions ---------------------------------------------------------*/
+
+/*
+ * Kernel generator. CPOL, CPHA and LSB are literals, so every branch on
+ * them folds away and each bit is a straight sequence of BSRR writes and
+ * one IDR read. The optional delay restarts from the DWT tick it ended on,
+ * t = max(t + half, now), so an edge delayed by preemption is followed by
+ * a full half period rather than a burst of short ones catching up.
+ *
+ * CPHA = 0: MOSI set, leading edge samples MISO, trailing edge.
+ * CPHA = 1: leading edge with MOSI set, trailing edge samples MISO.
+ */
+#define SOFT_SPI_WAIT()                                                         \
+    do {                                                                        \
+        if (half != 0U) {                                                       \
+            uint32_t now_;                                                      \
+            do {                                                                \
+                now_ = BSP_DWT_GetTick();                                       \
+            } while ((now_ - t) < half);                                        \
+            t = now_;                                                           \
+        }                                                                       \
+    } while (0)
+
+#define SOFT_SPI_BIT(CPOL, CPHA, LSB, n)                                        \
+    do {                                                                        \
+        const uint32_t shift = (LSB) ? (n) : (7U - (n));                        \
+        const uint32_t mosi = (((out >> shift) & 1U) != 0U) ? mosi_set : mosi_clr; \
+        if ((CPHA) == 0) {                                                      \
+            mosi_port->BSRR = mosi;                                             \
+            SOFT_SPI_WAIT();                                                    \
+            sck_port->BSRR = (CPOL) ? sck_clr : sck_set;                        \
+            in |= ((miso_port->IDR & miso_mask) != 0U) ? (1U << shift) : 0U;    \
+            SOFT_SPI_WAIT();                                                    \
+            sck_port->BSRR = (CPOL) ? sck_set : sck_clr;                        \
+        } else {                                                                \
+            sck_port->BSRR = (CPOL) ? sck_clr : sck_set;                        \
+            mosi_port->BSRR = mosi;                                             \
+            SOFT_SPI_WAIT();                                                    \
+            sck_port->BSRR = (CPOL) ? sck_set : sck_clr;                        \
+            in |= ((miso_port->IDR & miso_mask) != 0U) ? (1U << shift) : 0U;    \
+            SOFT_SPI_WAIT();                                                    \
+        }                                                                       \
+    } while (0)
+
+#define SOFT_SPI_KERNEL(NAME, CPOL, CPHA, LSB)                                  \
+static void NAME(const struct soft_spi_hw *hw, const uint8_t *tx_buf,           \
+                 uint8_t *rx_buf, size_t len)                                   \
+{                                                                               \
+    GPIO_TypeDef *const sck_port  = hw->sck_port;                               \
+    GPIO_TypeDef *const mosi_port = hw->mosi_port;                              \
+    GPIO_TypeDef *const miso_port = hw->miso_port;                              \
+    const uint32_t sck_set  = hw->sck_mask;                                     \
+    const uint32_t sck_clr  = hw->sck_mask << 16U;                              \
+    const uint32_t mosi_set = hw->mosi_mask;                                    \
+    const uint32_t mosi_clr = hw->mosi_mask << 16U;                             \
+    const uint32_t miso_mask = hw->miso_mask;                                   \
+    const uint32_t half = hw->half_cycles;                                      \
+    uint32_t t = BSP_DWT_GetTick();                                             \
+    uint32_t out;                                                               \
+    uint32_t in;                                                                \
+    size_t i;                                                                   \
+                                                                                \
+    for (i = 0U; i < len; i++) {                                                \
+        out = (tx_buf != NULL) ? tx_buf[i] : 0x00U;                             \
+        in  = 0U;                                                               \
+        SOFT_SPI_BIT(CPOL, CPHA, LSB, 0U);                                      \
+        SOFT_SPI_BIT(CPOL, CPHA, LSB, 1U);                                      \
+        SOFT_SPI_BIT(CPOL, CPHA, LSB, 2U);                                      \
+        SOFT_SPI_BIT(CPOL, CPHA, LSB, 3U);                                      \
+        SOFT_SPI_BIT(CPOL, CPHA, LSB, 4U);                                      \
+        SOFT_SPI_BIT(CPOL, CPHA, LSB, 5U);                                      \
+        SOFT_SPI_BIT(CPOL, CPHA, LSB, 6U);                                      \
+        SOFT_SPI_BIT(CPOL, CPHA, LSB, 7U);                                      \
+        if (rx_buf != NULL) {                                                   \
+            rx_buf[i] = (uint8_t)in;                                            \
+        }                                                                       \
+    }                                                                           \
+}
+
+SOFT_SPI_KERNEL(soft_spi_mode0_msb, 0, 0, 0)
+SOFT_SPI_KERNEL(soft_spi_mode1_msb, 0, 1, 0)
+SOFT_SPI_KERNEL(soft_spi_mode2_msb, 1, 0, 0)
+SOFT_SPI_KERNEL(soft_spi_mode3_msb, 1, 1, 0)
+SOFT_SPI_KERNEL(soft_spi_mode0_lsb, 0, 0, 1)
+SOFT_SPI_KERNEL(soft_spi_mode1_lsb, 0, 1, 1)
+SOFT_SPI_KERNEL(soft_spi_mode2_lsb, 1, 0, 1)
+SOFT_SPI_KERNEL(soft_spi_mode3_lsb, 1, 1, 1)
+
+/* Indexed by (LSB << 2) | (CPOL << 1) | CPHA */
+static const soft_spi_kernel_t soft_spi_kernels[8] = {
+    soft_spi_mode0_msb, soft_spi_mode1_msb, soft_spi_mode2_msb, soft_spi_mode3_msb,
+    soft_spi_mode0_lsb, soft_spi_mode1_lsb, soft_spi_mode2_lsb, soft_spi_mode3_lsb,
+};
+
+/**
+ * @brief Setup controller (spi_controller_ops implementation)
+ * @param ctrl Controller pointer
+ * @param dev Device pointer
+ * @return 0 on success, error code on failure
+ */
+static int soft_spi_setup(struct spi_controller *ctrl, struct spi_device *dev)
+{
+    struct soft_spi_hw *hw;
+    uint32_t idx;
+    uint32_t half;
+
+    if ((ctrl == NULL) || (dev == NULL) || (ctrl->priv == NULL)) {
+        return -EINVAL;
+    }
+
+    /* Full duplex 8-bit frames only */
+    if (((dev->mode & SPI_MODE_3WIRE) != 0U) || (dev->bits_per_word != 8U) ||
+        (dev->max_speed_hz == 0U)) {
+        return -EINVAL;
+    }
+
+    hw = (struct soft_spi_hw *)ctrl->priv;
+
+    idx = (((dev->mode & SPI_MODE_MSB) == 0U) ? 4U : 0U) |
+          (((dev->mode & SPI_CPOL) != 0U) ? 2U : 0U) |
+          (((dev->mode & SPI_CPHA) != 0U) ? 1U : 0U);
+    hw->kernel = soft_spi_kernels[idx];
+
+    /* Park SCK at its idle level */
+    hw->sck_port->BSRR = ((dev->mode & SPI_CPOL) != 0U) ? hw->sck_mask : (hw->sck_mask << 16U);
+
+    /* Half period; 0 when the bare kernel is already slower than requested */
+    half = (SystemCoreClock + (2U * dev->max_speed_hz) - 1U) / (2U * dev->max_speed_hz);
+    hw->half_cycles = (half > BSP_SOFT_SPI_EDGE_CYCLES) ? half : 0U;
+    if (half < BSP_SOFT_SPI_EDGE_CYCLES) {
+        half = BSP_SOFT_SPI_EDGE_CYCLES;
+    }
+
+    ctrl->actual_speed_hz = SystemCoreClock / (2U * half);
+
+    return 0;
+}
+
+/**
+ * @brief Set chip select state (spi_controller_ops implementation)
+ * @param ctrl Controller pointer
+ * @param dev Device pointer
+ * @param enable 1=activate (pull low), 0=release (pull high)
+ */
+static void soft_spi_set_cs(struct spi_controller *ctrl, struct spi_device *dev, uint8_t enable)
+{
+    if ((ctrl == NULL) || (dev == NULL)) {
+        return;
+    }
+
+    gpio_write(dev->cs_pin, (enable != 0U) ? 0U : 1U);
+}
+
+/**
+ * @brief Execute single transfer (spi_controller_ops implementation)
+ * @param ctrl Controller pointer
+ * @param dev Device pointer
+ * @param transfer Transfer descriptor pointer
+ * @return Number of bytes transferred on success, error code on failure
+ */
+static ssize_t soft_spi_transfer_one(struct spi_controller *ctrl,
+                                     struct spi_device *dev,
+                                     struct spi_transfer *transfer)
+{
+    struct soft_spi_hw *hw;
+
+    if ((ctrl == NULL) || (dev == NULL) || (transfer == NULL) || (ctrl->priv == NULL)) {
+        return -EINVAL;
+    }
+
+    hw = (struct soft_spi_hw *)ctrl->priv;
+    if (hw->kernel == NULL) {
+        return -EIO;
+    }
+
+    if (transfer->len == 0U) {
+        return 0;
+    }
+
+    hw->kernel(hw, (const uint8_t *)transfer->tx_buf, (uint8_t *)transfer->rx_buf, transfer->len);
+
+    return (ssize_t)transfer->len;
+}
+
+/**
+ * @brief Controller operations
+ */
+static const struct spi_controller_ops soft_spi_ops = {
+    .setup = soft_spi_setup,
+    .set_cs = soft_spi_set_cs,
+    .transfer_one = soft_spi_transfer_one,
+};
+
+/* Exported functions --------------------------------------------------------*/
+
+/**
+ * @brief Initialize the bit-banged SPI controllers
+ * @return 0 on success, error code on failure
+ * @note GPIO port clocks are expected to be enabled by the board setup.
+ */
+int bsp_soft_spi_init(void)
+{
+    LL_GPIO_InitTypeDef gpio_init = {0};
+    struct soft_spi_hw *hw;
+    size_t i;
+    int ret;
+
+    /* Edge timing runs on the DWT cycle counter */
+    BSP_DWT_Init();
+
+    for (i = 0U; i < sizeof(soft_spi_hw) / sizeof(soft_spi_hw[0]); i++) {
+        hw = &soft_spi_hw[i];
+
+        hw->sck_mask  = SOFT_SPI_PIN_MASK(hw->sck_pin);
+        hw->mosi_mask = SOFT_SPI_PIN_MASK(hw->mosi_pin);
+        hw->miso_mask = SOFT_SPI_PIN_MASK(hw->miso_pin);
+
+        gpio_init.Mode = LL_GPIO_MODE_OUTPUT;
+        gpio_init.Speed = LL_GPIO_SPEED_FREQ_HIGH;
+        gpio_init.OutputType = LL_GPIO_OUTPUT_PUSHPULL;
+        gpio_init.Pin = hw->sck_pin;
+        LL_GPIO_Init(hw->sck_port, &gpio_init);
+
+        gpio_init.Pin = hw->mosi_pin;
+        LL_GPIO_Init(hw->mosi_port, &gpio_init);
+
+        gpio_init.Pin = hw->miso_pin;
+        gpio_init.Mode = LL_GPIO_MODE_FLOATING;
+        LL_GPIO_Init(hw->miso_port, &gpio_init);
+
+        ret = spi_controller_register(&soft_spi_controller[i], hw->name, &soft_spi_ops);
+        if (ret != 0) {
+            LOG_E("Failed to register SPI controller '%s'", hw->name);
+            return ret;
+        }
+
+        soft_spi_controller[i].priv = hw;
+
+        LOG_I("SPI controller '%s' initialized", hw->name);
+    }
+
+    return 0;
+}
+
+#endif
@@ -0,0 +1,48 @@
+/**
+  ******************************************************************************
+  * @file        : bsp_soft_spi.h
+  * @author      : ZJY
+  * @version     : V1.0
+  * @date        : 2025-01-XX
+  * @brief       : Bit-banged SPI controller header file
+  * @attention   : None
+  ******************************************************************************
+  * @history     :
+  *         V1.0 : 1. Mode-specialized kernels on direct BSRR/IDR access
+  *                2. Registered through the SPI framework interface
+  *
+  ******************************************************************************
+  */
+#ifndef __BSP_SOFT_SPI_H__
+#define __BSP_SOFT_SPI_H__
+
+#ifdef __cplusplus
+ extern "C" {
+#endif /* __cplusplus */
+
+/* Includes ------------------------------------------------------------------*/
+#include "spi.h"
+
+/* Exported types ------------------------------------------------------------*/
+
+/* Exported constants --------------------------------------------------------*/
+
+/* Exported macros -----------------------------------------------------------*/
+
+/* Exported variables --------------------------------------------------------*/
+
+/* Exported functions --------------------------------------------------------*/
+
+/**
+ * @brief Initialize the bit-banged SPI controllers
+ * @return 0 on success, error code on failure
+ * @note Controllers are named "soft_spi1", "soft_spi2" and use the pins
+ *       BSP_SOFT_SPIx_{SCK,MOSI,MISO}_{PORT,PIN} from bsp_conf.h.
+ */
+int bsp_soft_spi_init(void);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __BSP_SOFT_SPI_H__ */
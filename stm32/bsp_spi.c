@@ -21,6 +21,14 @@
 #include "errno-base.h"
 #include "bsp_conf.h"
 #include "system_stm32f1xx.h"  /* For SystemCoreClock and APBPrescTable */
+#include "bsp_dwt.h"
+#include <string.h>
+
+/* FreeRTOS support */
+#if defined(USING_FREERTOS) || defined(configUSE_MUTEXES)
+#include "FreeRTOS.h"
+#include "task.h"
+#endif
 
 #define  LOG_TAG             "bsp_spi"
 #define  LOG_LVL             4
@@ -30,6 +38,58 @@
 
 #if defined(BSP_USING_SPI1) || defined(BSP_USING_SPI2) || defined(BSP_USING_SPI3)
 
+/* Number of devices per controller whose register image is cached */
+#ifndef BSP_SPI_CFG_CACHE_SIZE
+    #define BSP_SPI_CFG_CACHE_SIZE      (4U)
+#endif
+
+/* Number of devices per controller that can run with hardware CRC */
+#ifndef BSP_SPI_CRC_DEVICES
+    #define BSP_SPI_CRC_DEVICES         (2U)
+#endif
+
+/**
+ * @brief Device registered for hardware CRC
+ */
+struct stm32_spi_crc_dev {
+    const struct spi_device *dev;    /**< Device, NULL when the slot is free */
+    uint16_t poly;                   /**< CRC polynomial */
+};
+
+/**
+ * @brief Slave mode state
+ */
+struct stm32_spi_slave {
+    uint8_t active;                  /**< Controller runs as slave */
+    uint8_t nss_pin;                 /**< NSS pin id (EXTI on the rising edge) */
+    uint16_t cr1;                    /**< CR1 image without SPE */
+    uint8_t *ring;                   /**< RX ring, filled by circular DMA */
+    uint16_t ring_size;              /**< RX ring size */
+    uint16_t frame_start;            /**< Ring offset of the current frame */
+    bsp_spi_slave_frame_t frame_cb;  /**< Frame callback */
+    void *arg;                       /**< Callback argument */
+    const uint8_t *tx_next;          /**< Response armed for the next frame */
+    uint16_t tx_next_len;            /**< Length of tx_next */
+    uint16_t tx_cur_len;             /**< Length of the response in flight, 0 if none */
+    struct bsp_spi_slave_stats stats; /**< Counters */
+};
+
+/**
+ * @brief Cached register image of one device
+ */
+struct stm32_spi_cfg {
+    const struct spi_device *dev;    /**< Owner, NULL when the slot is free */
+    uint32_t mode;                   /**< dev->mode the image was built from */
+    uint32_t max_speed_hz;           /**< dev->max_speed_hz the image was built from */
+    uint8_t bits_per_word;           /**< dev->bits_per_word the image was built from */
+    uint16_t cr1;                    /**< CR1 image without SPE */
+    uint16_t cr2;                    /**< CR2 image */
+    uint16_t crcpr;                  /**< CRC polynomial, used when CR1 has CRCEN */
+    uint32_t requested_hz;           /**< Requested SCK frequency after clamping */
+    uint32_t actual_speed_hz;        /**< Resulting SCK frequency */
+    uint32_t cycles_per_byte;        /**< CPU cycles per byte at that frequency */
+};
+
 /**
  * @brief STM32 SPI hardware data structure
  */
@@ -38,6 +98,29 @@ struct stm32_spi_hw {
     IRQn_Type irq_type;             /**< SPI interrupt type */
     uint32_t pclk_freq;              /**< Peripheral clock frequency */
     uint32_t max_speed_hz;           /**< Maximum SPI speed */
+    uint32_t cycles_per_byte;        /**< CPU cycles per byte at the programmed speed */
+    DMA_TypeDef *dma;                /**< DMA controller, NULL when DMA is not used */
+    uint32_t dma_rx_ch;              /**< RX DMA channel (LL_DMA_CHANNEL_x) */
+    uint32_t dma_tx_ch;              /**< TX DMA channel (LL_DMA_CHANNEL_x) */
+    IRQn_Type dma_irq;               /**< RX DMA channel interrupt */
+    struct spi_controller *ctrl;     /**< Registered controller */
+    struct bsp_spi_msg *async_head;  /**< First queued async message */
+    struct bsp_spi_msg *async_tail;  /**< Last queued async message */
+    struct bsp_spi_msg *volatile async_cur; /**< Async message on the bus */
+    uint8_t async_frame16;           /**< Frame size of async_cur */
+    uint8_t async_cs;                /**< CS of async_cur is asserted */
+    struct spi_device *cs_held;      /**< Device left selected by a final cs_change */
+    volatile uint8_t async_busy;     /**< A context is driving the queue */
+    volatile uint8_t async_armed;    /**< Async DMA transfer in flight */
+    uint32_t async_start;            /**< DWT tick the async DMA transfer started */
+    uint32_t async_budget;           /**< Cycles allowed for the async DMA transfer */
+    volatile uint8_t sync_busy;      /**< transfer_one() owns the bus */
+    uint8_t crc_active;              /**< Programmed device uses hardware CRC */
+    struct stm32_spi_slave slave;    /**< Slave mode state */
+    struct stm32_spi_crc_dev crc_devs[BSP_SPI_CRC_DEVICES]; /**< CRC registrations */
+    struct stm32_spi_cfg cfg_cache[BSP_SPI_CFG_CACHE_SIZE]; /**< Per-device register images */
+    uint8_t cfg_next;                /**< Next cache slot to replace */
+    struct stm32_spi_cfg *cur_cfg;   /**< Image last programmed, NULL if none */
     const char *name;                /**< Controller name */
 };
 
@@ -65,6 +148,35 @@ enum
 /* For safety, we use a conservative value: 18MHz */
 #define STM32_SPI_MAX_SPEED_HZ          (18000000U)  /* 18 MHz - datasheet limit */
 
+/* Transfers of at least this many bytes use DMA when the controller has it */
+#ifndef BSP_SPI_DMA_THRESHOLD
+    #define BSP_SPI_DMA_THRESHOLD       (16U)
+#endif
+
+/* Preemption priority of the SPI DMA interrupts (async queue) */
+#ifndef BSP_SPI_DMA_IRQ_PRIORITY
+    #define BSP_SPI_DMA_IRQ_PRIORITY    (5U)
+#endif
+
+/* Fixed slack added to every transfer deadline (CPU cycles) */
+#define STM32_SPI_TIMEOUT_SLACK_CYCLES  (100000U)
+
+/* DMA1/DMA2 ISR/IFCR flags are 4 bits per channel, LL channels start at 1 */
+#define STM32_DMA_FLAG(ch, flag)        ((uint32_t)(flag) << (((ch) - 1U) * 4U))
+
+/*
+ * With DMA enabled this driver owns the channel pair and its IRQ handler:
+ * SPI1 DMA1 channel 2/3 (shared with USART3 TX/RX), SPI2 DMA1 channel 4/5
+ * (shared with USART1 TX/RX), SPI3 DMA2 channel 1/2. UART DMA is linked by
+ * CubeMX, the board declares it with BSP_UARTx_USING_DMA.
+ */
+#if defined(BSP_SPI1_USING_DMA) && defined(BSP_UART3_USING_DMA)
+#error "BSP_SPI1_USING_DMA and BSP_UART3_USING_DMA share DMA1 channel 2/3"
+#endif
+#if defined(BSP_SPI2_USING_DMA) && defined(BSP_UART1_USING_DMA)
+#error "BSP_SPI2_USING_DMA and BSP_UART1_USING_DMA share DMA1 channel 4/5"
+#endif
+
 /* Private macro -------------------------------------------------------------*/
 
 /* Private variables ---------------------------------------------------------*/
@@ -77,6 +189,12 @@ static struct stm32_spi_hw stm32_spi_hw[SPI_INDEX_MAX] = {
         .irq_type = SPI1_IRQn,
         .pclk_freq = 0U,  /* Will be calculated in init */
         .max_speed_hz = 0U,
+#ifdef BSP_SPI1_USING_DMA
+        .dma = DMA1,
+        .dma_rx_ch = LL_DMA_CHANNEL_2,
+        .dma_tx_ch = LL_DMA_CHANNEL_3,
+        .dma_irq = DMA1_Channel2_IRQn,
+#endif
         .name = "spi1"
     },
 #endif
@@ -86,6 +204,12 @@ static struct stm32_spi_hw stm32_spi_hw[SPI_INDEX_MAX] = {
         .irq_type = SPI2_IRQn,
         .pclk_freq = 0U,
         .max_speed_hz = 0U,
+#ifdef BSP_SPI2_USING_DMA
+        .dma = DMA1,
+        .dma_rx_ch = LL_DMA_CHANNEL_4,
+        .dma_tx_ch = LL_DMA_CHANNEL_5,
+        .dma_irq = DMA1_Channel4_IRQn,
+#endif
         .name = "spi2"
     },
 #endif
@@ -95,6 +219,12 @@ static struct stm32_spi_hw stm32_spi_hw[SPI_INDEX_MAX] = {
         .irq_type = SPI3_IRQn,
         .pclk_freq = 0U,
         .max_speed_hz = 0U,
+#ifdef BSP_SPI3_USING_DMA
+        .dma = DMA2,
+        .dma_rx_ch = LL_DMA_CHANNEL_1,
+        .dma_tx_ch = LL_DMA_CHANNEL_2,
+        .dma_irq = DMA2_Channel1_IRQn,
+#endif
         .name = "spi3"
     },
 #endif
@@ -105,6 +235,8 @@ static struct spi_controller stm32_spi_controller[sizeof(stm32_spi_hw) / sizeof(
 
 /* Private function prototypes -----------------------------------------------*/
 static int stm32_spi_setup(struct spi_controller *ctrl, struct spi_device *dev);
+static int stm32_spi_build_cfg(struct stm32_spi_hw *hw, const struct spi_device *dev,
+                               struct stm32_spi_cfg *cfg);
 static void stm32_spi_set_cs(struct spi_controller *ctrl, struct spi_device *dev, uint8_t enable);
 static ssize_t stm32_spi_transfer_one(struct spi_controller *ctrl, 
                                        struct spi_device *dev,
@@ -112,6 +244,37 @@ static ssize_t stm32_spi_transfer_one(struct spi_controller *ctrl,
 static int stm32_spi_gpio_init(SPI_TypeDef *spi_instance);
 static uint32_t stm32_spi_calculate_prescaler(uint32_t pclk_freq, uint32_t max_speed_hz, uint32_t *actual_speed);
 static uint32_t stm32_spi_get_pclk_freq(SPI_TypeDef *spi_instance);
+static int stm32_spi_update_clock(struct stm32_spi_hw *hw);
+static ssize_t stm32_spi_transfer_dma(struct stm32_spi_hw *hw, const uint8_t *tx_buf,
+                                      uint8_t *rx_buf, size_t len, uint8_t frame16);
+static int stm32_spi_configure(struct stm32_spi_hw *hw, const struct spi_device *dev);
+static uint32_t stm32_spi_use_dma(const struct stm32_spi_hw *hw, const uint8_t *tx_buf,
+                                  const uint8_t *rx_buf, size_t len, uint8_t frame16);
+static ssize_t stm32_spi_transfer_poll(struct stm32_spi_hw *hw, const uint8_t *tx_buf,
+                                       uint8_t *rx_buf, size_t len, uint8_t frame16);
+static void stm32_spi_dma_start(struct stm32_spi_hw *hw, const uint8_t *tx_buf,
+                                uint8_t *rx_buf, size_t len, uint8_t frame16, uint8_t irq);
+static void stm32_spi_dma_stop(struct stm32_spi_hw *hw);
+static struct stm32_spi_hw *stm32_spi_find(const char *bus);
+static void stm32_spi_async_run(struct stm32_spi_hw *hw);
+static void stm32_spi_async_xfer_done(struct stm32_spi_hw *hw, ssize_t ret);
+static void stm32_spi_dma_irq(struct stm32_spi_hw *hw);
+static void stm32_spi_async_watchdog(struct stm32_spi_hw *hw);
+static ssize_t stm32_spi_transfer_run(struct stm32_spi_hw *hw, const uint8_t *tx_buf,
+                                      uint8_t *rx_buf, size_t len, uint8_t frame16);
+static inline uint32_t stm32_spi_expired(uint32_t start, uint32_t budget);
+static void stm32_spi_crc_reset(SPI_TypeDef *spi);
+static void stm32_spi_periph_reset(SPI_TypeDef *spi);
+static void stm32_spi_gpio_slave(SPI_TypeDef *spi);
+static void stm32_spi_slave_arm(struct stm32_spi_hw *hw);
+static void stm32_spi_slave_nss_isr(void *args);
+static ssize_t stm32_spi_crc_finish(struct stm32_spi_hw *hw, uint32_t start, uint32_t budget);
+static ssize_t stm32_spi_xfer8(SPI_TypeDef *spi, const uint8_t *tx_buf,
+                               uint8_t *rx_buf, size_t len, uint8_t crc,
+                               uint32_t start, uint32_t budget);
+static ssize_t stm32_spi_xfer16(SPI_TypeDef *spi, const uint8_t *tx_buf,
+                                uint8_t *rx_buf, size_t len, uint8_t crc,
+                                uint32_t start, uint32_t budget);
 
 /* Exported functions --------------------------------------------------------*/
 
@@ -252,36 +415,24 @@ static int stm32_spi_gpio_init(SPI_TypeDef *spi_instance)
 }
 
 /**
- * @brief Setup SPI controller (spi_controller_ops implementation)
- * @param ctrl Controller pointer
+ * @brief Compute the register image for a device
+ * @param hw Hardware data pointer
  * @param dev Device pointer
+ * @param cfg Cache entry to fill
  * @return 0 on success, error code on failure
+ * @note Mirrors what LL_SPI_Init() would program, without touching the
+ *       peripheral.
  */
-static int stm32_spi_setup(struct spi_controller *ctrl, struct spi_device *dev)
+static int stm32_spi_build_cfg(struct stm32_spi_hw *hw, const struct spi_device *dev,
+                               struct stm32_spi_cfg *cfg)
 {
-    struct stm32_spi_hw *hw;
-    LL_SPI_InitTypeDef spi_init = {0};
     uint32_t prescaler;
     uint32_t actual_speed;
     uint32_t polarity;
     uint32_t phase;
     uint32_t bit_order;
     uint32_t transfer_dir;
-    
-    if ((ctrl == NULL) || (dev == NULL) || (ctrl->priv == NULL)) {
-        return -EINVAL;
-    }
-    
-    hw = (struct stm32_spi_hw *)ctrl->priv;
-    
-    /* Disable SPI before configuration */
-    if (LL_SPI_IsEnabled(hw->instance) != 0U) {
-        LL_SPI_Disable(hw->instance);
-        /* Wait for SPI to be disabled */
-        while (LL_SPI_IsEnabled(hw->instance) != 0U) {
-            /* Wait */
-        }
-    }
+    uint32_t data_width;
     
     /* Configure transfer direction */
     if ((dev->mode & SPI_MODE_3WIRE) != 0U) {
@@ -311,6 +462,8 @@ static int stm32_spi_setup(struct spi_controller *ctrl, struct spi_device *dev)
         bit_order = LL_SPI_LSB_FIRST;
     }
     
+    data_width = (dev->bits_per_word == 16U) ? LL_SPI_DATAWIDTH_16BIT : LL_SPI_DATAWIDTH_8BIT;
+    
     /* Limit requested speed to hardware maximum */
     uint32_t requested_speed = dev->max_speed_hz;
     if (requested_speed > hw->max_speed_hz) {
@@ -329,32 +482,116 @@ static int stm32_spi_setup(struct spi_controller *ctrl, struct spi_device *dev)
         return -EINVAL;
     }
     
-    /* Fill SPI init structure */
-    LL_SPI_StructInit(&spi_init);
-    
-    spi_init.TransferDirection = transfer_dir;
-    spi_init.Mode = LL_SPI_MODE_MASTER;
-    spi_init.DataWidth = (dev->bits_per_word == 16U) ? 
-                        LL_SPI_DATAWIDTH_16BIT : LL_SPI_DATAWIDTH_8BIT;
-    spi_init.ClockPolarity = polarity;
-    spi_init.ClockPhase = phase;
-    spi_init.NSS = LL_SPI_NSS_SOFT;  /* Always use software NSS */
-    spi_init.BaudRate = prescaler;
-    spi_init.BitOrder = bit_order;
-    spi_init.CRCCalculation = LL_SPI_CRCCALCULATION_DISABLE;
-    spi_init.CRCPoly = 7U;
-    
-    /* Initialize SPI */
-    if (LL_SPI_Init(hw->instance, &spi_init) != SUCCESS) {
-        LOG_E("Failed to initialize SPI%s", hw->name);
-        return -EIO;
+    /* Master, software NSS (always), SPE left clear */
+    cfg->cr1 = (uint16_t)(transfer_dir | LL_SPI_MODE_MASTER | data_width | polarity |
+                          phase | (LL_SPI_NSS_SOFT & 0xFFFFU) | prescaler | bit_order);
+    cfg->cr2 = (uint16_t)(LL_SPI_NSS_SOFT >> 16U);
+    cfg->crcpr = 0U;
+    
+    /* Hardware CRC for registered devices */
+    for (uint32_t i = 0U; i < BSP_SPI_CRC_DEVICES; i++) {
+        if (hw->crc_devs[i].dev == dev) {
+            cfg->cr1  |= (uint16_t)SPI_CR1_CRCEN;
+            cfg->crcpr = hw->crc_devs[i].poly;
+            break;
+        }
+    }
+    
+    cfg->dev             = dev;
+    cfg->mode            = dev->mode;
+    cfg->max_speed_hz    = dev->max_speed_hz;
+    cfg->bits_per_word   = dev->bits_per_word;
+    cfg->requested_hz    = requested_speed;
+    cfg->actual_speed_hz = actual_speed;
+    cfg->cycles_per_byte = (uint32_t)(((uint64_t)SystemCoreClock * 8U + actual_speed - 1U) / actual_speed);
+    
+    return 0;
+}
+
+/**
+ * @brief Setup SPI controller (spi_controller_ops implementation)
+ * @param ctrl Controller pointer
+ * @param dev Device pointer
+ * @return 0 on success, error code on failure
+ * @note The register image of each device is computed once and cached.
+ *       Switching back to a device whose settings have not changed costs
+ *       nothing when it is already programmed, otherwise two CR1 writes
+ *       (plus CR2 when it differs).
+ */
+static int stm32_spi_setup(struct spi_controller *ctrl, struct spi_device *dev)
+{
+    struct stm32_spi_hw *hw;
+    
+    if ((ctrl == NULL) || (dev == NULL) || (ctrl->priv == NULL)) {
+        return -EINVAL;
+    }
+    
+    hw = (struct stm32_spi_hw *)ctrl->priv;
+    
+    /* The bus belongs to the async queue until it drains, or to the slave */
+    if ((hw->async_cur != NULL) || (hw->slave.active != 0U)) {
+        return -EBUSY;
+    }
+    
+    return stm32_spi_configure(hw, dev);
+}
+
+/**
+ * @brief Program the controller for a device
+ * @param hw Hardware data pointer
+ * @param dev Device pointer
+ * @return 0 on success, error code on failure
+ */
+static int stm32_spi_configure(struct stm32_spi_hw *hw, const struct spi_device *dev)
+{
+    struct stm32_spi_cfg *cfg = NULL;
+    SPI_TypeDef *spi = hw->instance;
+    uint32_t i;
+    int ret;
+    
+    /* Look up the device image, rebuild it when the device settings changed */
+    for (i = 0U; i < BSP_SPI_CFG_CACHE_SIZE; i++) {
+        if (hw->cfg_cache[i].dev == dev) {
+            cfg = &hw->cfg_cache[i];
+            break;
+        }
+    }
+    
+    if ((cfg == NULL) || (cfg->mode != dev->mode) ||
+        (cfg->max_speed_hz != dev->max_speed_hz) ||
+        (cfg->bits_per_word != dev->bits_per_word)) {
+        if (cfg == NULL) {
+            cfg = &hw->cfg_cache[hw->cfg_next];
+            hw->cfg_next = (uint8_t)((hw->cfg_next + 1U) % BSP_SPI_CFG_CACHE_SIZE);
+        }
+        cfg->dev = NULL;
+        ret = stm32_spi_build_cfg(hw, dev, cfg);
+        if (ret != 0) {
+            return ret;
+        }
     }
     
-    /* Enable SPI */
-    LL_SPI_Enable(hw->instance);
+    hw->crc_active = ((cfg->cr1 & SPI_CR1_CRCEN) != 0U) ? 1U : 0U;
+    hw->cur_cfg    = cfg;
+    
+    /* Program only what differs from the live registers */
+    if (((spi->CR1 & ~SPI_CR1_SPE) != cfg->cr1) || (spi->CR2 != cfg->cr2) ||
+        ((hw->crc_active != 0U) && (spi->CRCPR != cfg->crcpr))) {
+        spi->CR1 = cfg->cr1;  /* SPE cleared together with the new image */
+        if (spi->CR2 != cfg->cr2) {
+            spi->CR2 = cfg->cr2;
+        }
+        if ((hw->crc_active != 0U) && (spi->CRCPR != cfg->crcpr)) {
+            spi->CRCPR = cfg->crcpr;
+        }
+        spi->CR1 = (uint32_t)cfg->cr1 | SPI_CR1_SPE;
+    } else if ((spi->CR1 & SPI_CR1_SPE) == 0U) {
+        spi->CR1 = (uint32_t)cfg->cr1 | SPI_CR1_SPE;
+    }
     
     /* Save actual speed to controller (will be read by framework) */
-    ctrl->actual_speed_hz = actual_speed;
+    hw->ctrl->actual_speed_hz = cfg->actual_speed_hz;
+    hw->cycles_per_byte   = cfg->cycles_per_byte;
     
     return 0;
 }
@@ -367,10 +604,28 @@ static int stm32_spi_setup(struct spi_controller *ctrl, struct spi_device *dev)
  */
 static void stm32_spi_set_cs(struct spi_controller *ctrl, struct spi_device *dev, uint8_t enable)
 {
+    struct stm32_spi_hw *hw;
+    struct spi_device *held;
+    uint32_t level;
+    
     if ((ctrl == NULL) || (dev == NULL)) {
         return;
     }
     
+    /* A message ending with cs_change keeps its device selected until the
+     * bus is used for another device or that device is released */
+    hw = (struct stm32_spi_hw *)ctrl->priv;
+    if (hw != NULL) {
+        level = __get_PRIMASK();
+        __disable_irq();
+        held = hw->cs_held;
+        hw->cs_held = NULL;
+        __set_PRIMASK(level);
+        if ((held != NULL) && (held != dev) && ((held->mode & SPI_MODE_HW_CS) == 0U)) {
+            gpio_write(held->cs_pin, 1U);
+        }
+    }
+    
     if ((dev->mode & SPI_MODE_HW_CS) == 0U) {
         /* Software CS: control GPIO */
         /* enable=1 means CS active (low), enable=0 means CS inactive (high) */
@@ -394,14 +649,10 @@ static ssize_t stm32_spi_transfer_one(struct spi_controller *ctrl,
                                      struct spi_transfer *transfer)
 {
     struct stm32_spi_hw *hw;
-    SPI_TypeDef *spi;
-    const uint8_t *tx_buf;
-    uint8_t *rx_buf;
     size_t len;
-    size_t i;
-    uint8_t tx_byte;
-    uint8_t rx_byte;
-    uint32_t timeout;
+    uint32_t level;
+    uint8_t frame16;
+    ssize_t ret;
     
     if ((ctrl == NULL) || (dev == NULL) || (transfer == NULL) || (ctrl->priv == NULL)) {
         return -EINVAL;
@@ -412,11 +663,48 @@ static ssize_t stm32_spi_transfer_one(struct spi_controller *ctrl,
     }
     
     hw = (struct stm32_spi_hw *)ctrl->priv;
-    spi = hw->instance;
-    tx_buf = (const uint8_t *)transfer->tx_buf;
-    rx_buf = (uint8_t *)transfer->rx_buf;
     len = transfer->len;
     
+    /* 16-bit frames move whole halfwords, a trailing odd byte is not allowed */
+    frame16 = (dev->bits_per_word == 16U) ? 1U : 0U;
+    if ((frame16 != 0U) && ((len & 1U) != 0U)) {
+        return -EINVAL;
+    }
+    
+    /* The bus belongs to the async queue until it drains, or to the slave.
+     * Claim it so no async message starts while this transfer runs. */
+    level = __get_PRIMASK();
+    __disable_irq();
+    if ((hw->async_cur != NULL) || (hw->slave.active != 0U)) {
+        __set_PRIMASK(level);
+        return -EBUSY;
+    }
+    hw->sync_busy = 1U;
+    __set_PRIMASK(level);
+    
+    ret = stm32_spi_transfer_run(hw, (const uint8_t *)transfer->tx_buf,
+                                 (uint8_t *)transfer->rx_buf, len, frame16);
+    
+    hw->sync_busy = 0U;
+    
+    return ret;
+}
+
+/**
+ * @brief Execute a synchronous transfer on a claimed bus
+ * @param hw Hardware data pointer
+ * @param tx_buf TX data or NULL
+ * @param rx_buf RX buffer or NULL
+ * @param len Number of bytes (even for 16-bit frames)
+ * @param frame16 Non-zero for 16-bit frames
+ * @return Number of bytes transferred on success, error code on failure
+ */
+static ssize_t stm32_spi_transfer_run(struct stm32_spi_hw *hw, const uint8_t *tx_buf,
+                                      uint8_t *rx_buf, size_t len, uint8_t frame16)
+{
+    SPI_TypeDef *spi = hw->instance;
+    uint32_t timeout;
+    
     /* Check for errors */
     if (LL_SPI_IsActiveFlag_OVR(spi) != 0U) {
         LL_SPI_ClearFlag_OVR(spi);
@@ -438,51 +726,84 @@ static ssize_t stm32_spi_transfer_one(struct spi_controller *ctrl,
         return -EIO;
     }
     
-    /* Perform transfer */
-    for (i = 0U; i < len; i++) {
-        /* Prepare TX data */
-        if (tx_buf != NULL) {
-            tx_byte = tx_buf[i];
-        } else {
-            tx_byte = 0x00U;  /* Dummy byte for read */
-        }
-        
-        /* Wait for TX buffer empty */
-        timeout = 10000U;
-        while ((LL_SPI_IsActiveFlag_TXE(spi) == 0U) && (timeout > 0U)) {
-            timeout--;
-        }
-        
-        if (timeout == 0U) {
-            return (ssize_t)i;  /* Return bytes transferred so far */
-        }
-        
-        /* Send data */
-        LL_SPI_TransmitData8(spi, tx_byte);
-        
-        /* Wait for RX buffer not empty */
-        timeout = 10000U;
-        while ((LL_SPI_IsActiveFlag_RXNE(spi) == 0U) && (timeout > 0U)) {
-            timeout--;
-        }
-        
-        if (timeout == 0U) {
-            return (ssize_t)i;  /* Return bytes transferred so far */
-        }
-        
-        /* Read data */
-        rx_byte = LL_SPI_ReceiveData8(spi);
-        
-        /* Store RX data if buffer provided */
-        if (rx_buf != NULL) {
-            rx_buf[i] = rx_byte;
-        }
+    /* Bulk transfers: let the DMA move the data */
+    if (stm32_spi_use_dma(hw, tx_buf, rx_buf, len, frame16) != 0U) {
+        return stm32_spi_transfer_dma(hw, tx_buf, rx_buf, len, frame16);
     }
     
-    /* Wait for transfer to complete */
-    timeout = 10000U;
-    while ((LL_SPI_IsActiveFlag_BSY(spi) != 0U) && (timeout > 0U)) {
-        timeout--;
+    return stm32_spi_transfer_poll(hw, tx_buf, rx_buf, len, frame16);
+}
+
+/**
+ * @brief Check whether a transfer goes through DMA
+ * @param hw Hardware data pointer
+ * @param tx_buf TX data or NULL
+ * @param rx_buf RX buffer or NULL
+ * @param len Number of bytes
+ * @param frame16 Non-zero for 16-bit frames
+ * @return Non-zero to use DMA
+ * @note Halfword DMA needs halfword-aligned buffers.
+ */
+static uint32_t stm32_spi_use_dma(const struct stm32_spi_hw *hw, const uint8_t *tx_buf,
+                                  const uint8_t *rx_buf, size_t len, uint8_t frame16)
+{
+    if ((hw->dma == NULL) || (len < BSP_SPI_DMA_THRESHOLD) || ((len >> frame16) > 0xFFFFU)) {
+        return 0U;
+    }
+    
+    if ((frame16 != 0U) && ((((uintptr_t)tx_buf | (uintptr_t)rx_buf) & 1U) != 0U)) {
+        return 0U;
+    }
+    
+    return 1U;
+}
+
+/**
+ * @brief Execute a transfer with the polling kernels
+ * @param hw Hardware data pointer
+ * @param tx_buf TX data or NULL
+ * @param rx_buf RX buffer or NULL
+ * @param len Number of bytes (even for 16-bit frames)
+ * @param frame16 Non-zero for 16-bit frames
+ * @return Number of bytes transferred on success, error code on failure
+ */
+static ssize_t stm32_spi_transfer_poll(struct stm32_spi_hw *hw, const uint8_t *tx_buf,
+                                       uint8_t *rx_buf, size_t len, uint8_t frame16)
+{
+    SPI_TypeDef *spi = hw->instance;
+    uint32_t start;
+    uint32_t budget;
+    ssize_t ret;
+    
+    /* Drop a stale frame so RX starts aligned with TX */
+    if (LL_SPI_IsActiveFlag_RXNE(spi) != 0U) {
+        (void)LL_SPI_ReceiveData16(spi);
+    }
+    
+    if (hw->crc_active != 0U) {
+        stm32_spi_crc_reset(spi);
+    }
+    
+    /* One deadline for the whole transfer, twice the nominal wire time */
+    budget = ((uint32_t)len + 2U) * hw->cycles_per_byte * 2U + STM32_SPI_TIMEOUT_SLACK_CYCLES;
+    start  = BSP_DWT_GetTick();
+    
+    /* Perform transfer with the kernel matching the frame size */
+    if (frame16 != 0U) {
+        ret = stm32_spi_xfer16(spi, tx_buf, rx_buf, len, hw->crc_active, start, budget);
+    } else {
+        ret = stm32_spi_xfer8(spi, tx_buf, rx_buf, len, hw->crc_active, start, budget);
+    }
+    
+    if (ret != (ssize_t)len) {
+        return ret;
+    }
+    
+    /* Last frame received, BSY drops within a PCLK cycle or two */
+    while (LL_SPI_IsActiveFlag_BSY(spi) != 0U) {
+        if (stm32_spi_expired(start, budget) != 0U) {
+            break;
+        }
     }
     
     /* Check for overrun error */
@@ -491,106 +812,1497 @@ static ssize_t stm32_spi_transfer_one(struct spi_controller *ctrl,
         return -EIO;
     }
     
+    if ((hw->crc_active != 0U) && (LL_SPI_IsActiveFlag_CRCERR(spi) != 0U)) {
+        LL_SPI_ClearFlag_CRCERR(spi);
+        return -EBADMSG;
+    }
+    
     return (ssize_t)len;
 }
 
 /**
- * @brief SPI controller operations
+ * @brief Restart the CRC calculation
+ * @param spi SPI instance
+ * @note CRCEN may only change while SPE is clear; toggling it clears both
+ *       CRC registers.
  */
-static const struct spi_controller_ops stm32_spi_ops = {
-    .setup = stm32_spi_setup,
-    .set_cs = stm32_spi_set_cs,
-    .transfer_one = stm32_spi_transfer_one,
-};
+static void stm32_spi_crc_reset(SPI_TypeDef *spi)
+{
+    CLEAR_BIT(spi->CR1, SPI_CR1_SPE);
+    CLEAR_BIT(spi->CR1, SPI_CR1_CRCEN);
+    SET_BIT(spi->CR1, SPI_CR1_CRCEN);
+    SET_BIT(spi->CR1, SPI_CR1_SPE);
+}
 
 /**
- * @brief Get peripheral clock frequency for SPI
- * @param spi_instance SPI peripheral instance
- * @return Clock frequency in Hz, 0 on error
- * @note Uses LL library macros for cleaner implementation
+ * @brief Consume the received CRC frame after a DMA transfer
+ * @param hw Hardware data pointer
+ * @param start DWT tick the deadline is measured from
+ * @param budget Allowed cycles
+ * @return 0 on match, -EBADMSG on CRC mismatch, -EIO on timeout
+ * @note The RX DMA covers the data only, the CRC frame that follows
+ *       lands in DR and is read here so RXNE is clear for the next
+ *       transfer.
  */
-static uint32_t stm32_spi_get_pclk_freq(SPI_TypeDef *spi_instance)
+static ssize_t stm32_spi_crc_finish(struct stm32_spi_hw *hw, uint32_t start, uint32_t budget)
 {
-    uint32_t hclk_freq;
-    uint32_t apb_prescaler;
+    SPI_TypeDef *spi = hw->instance;
     
-    if (spi_instance == NULL) {
-        return 0U;
+    while (LL_SPI_IsActiveFlag_RXNE(spi) == 0U) {
+        if (stm32_spi_expired(start, budget) != 0U) {
+            return -EIO;
+        }
     }
+    (void)LL_SPI_ReceiveData16(spi);
     
-    /* Get HCLK frequency (SystemCoreClock) */
-    hclk_freq = SystemCoreClock;
+    if (LL_SPI_IsActiveFlag_CRCERR(spi) != 0U) {
+        LL_SPI_ClearFlag_CRCERR(spi);
+        return -EBADMSG;
+    }
     
-#if defined(BSP_USING_SPI1)
-    if (spi_instance == SPI1) {
-        /* SPI1 is on APB2 */
-        apb_prescaler = LL_RCC_GetAPB2Prescaler();
-        /* Use LL library macro to calculate PCLK2 frequency */
-        return __LL_RCC_CALC_PCLK2_FREQ(hclk_freq, apb_prescaler);
+    return 0;
+}
+
+/**
+ * @brief Check a DWT deadline
+ * @param start DWT tick at the start of the transfer
+ * @param budget Allowed cycles
+ * @return Non-zero once the budget is used up
+ */
+static inline uint32_t stm32_spi_expired(uint32_t start, uint32_t budget)
+{
+    return ((BSP_DWT_GetTick() - start) > budget) ? 1U : 0U;
+}
+
+/**
+ * @brief Polling kernel for 8-bit frames
+ * @param spi SPI instance
+ * @param tx_buf TX data, NULL to send 0x00
+ * @param rx_buf RX buffer, NULL to discard
+ * @param len Number of bytes
+ * @param crc Non-zero to send the hardware CRC after the data and
+ *            receive (and drop) the peer's CRC frame
+ * @param start DWT tick the deadline is measured from
+ * @param budget Cycles allowed for the whole transfer
+ * @return Number of bytes received (less than len on timeout), -EIO
+ *         when only the CRC frame timed out
+ * @note The next byte is written as soon as TXE is set, while the
+ *       previous one is still shifting, so the clock runs without gaps
+ *       between frames. At most two frames are in flight, which keeps
+ *       RX ahead of OVR unless the loop is preempted for longer than a
+ *       frame time; the caller reports that case from the OVR flag.
+ *       The deadline is only read while neither flag is ready.
+ */
+static ssize_t stm32_spi_xfer8(SPI_TypeDef *spi, const uint8_t *tx_buf,
+                               uint8_t *rx_buf, size_t len, uint8_t crc,
+                               uint32_t start, uint32_t budget)
+{
+    size_t tx_i = 0U;
+    size_t rx_i = 0U;
+    size_t rx_end = len + ((crc != 0U) ? 1U : 0U);
+    uint8_t rx_byte;
+    
+    while (rx_i < rx_end) {
+        if ((tx_i < len) && ((tx_i - rx_i) < 2U) && (LL_SPI_IsActiveFlag_TXE(spi) != 0U)) {
+            LL_SPI_TransmitData8(spi, (tx_buf != NULL) ? tx_buf[tx_i] : 0x00U);
+            tx_i++;
+            if ((crc != 0U) && (tx_i == len)) {
+                SET_BIT(spi->CR1, SPI_CR1_CRCNEXT);  /* CRC follows the last frame */
+            }
+        } else if (LL_SPI_IsActiveFlag_RXNE(spi) != 0U) {
+            rx_byte = LL_SPI_ReceiveData8(spi);
+            if ((rx_buf != NULL) && (rx_i < len)) {
+                rx_buf[rx_i] = rx_byte;
+            }
+            rx_i++;
+        } else if (stm32_spi_expired(start, budget) != 0U) {
+            break;
+        } else {
+            /* Frame still shifting */
+        }
     }
-#endif
     
-#if defined(BSP_USING_SPI2) || defined(BSP_USING_SPI3)
-    if ((spi_instance == SPI2) || (spi_instance == SPI3)) {
-        /* SPI2/3 are on APB1 */
-        apb_prescaler = LL_RCC_GetAPB1Prescaler();
-        /* Use LL library macro to calculate PCLK1 frequency */
-        return __LL_RCC_CALC_PCLK1_FREQ(hclk_freq, apb_prescaler);
+    if (rx_i < len) {
+        return (ssize_t)rx_i;
     }
-#endif
     
-    return 0U;
+    /* All data in but the peer CRC frame missing: nothing was checked */
+    if (rx_i < rx_end) {
+        return -EIO;
+    }
+    
+    return (ssize_t)len;
 }
 
 /**
- * @brief Initialize STM32 SPI BSP driver
- * @return 0 on success, error code on failure
+ * @brief Polling kernel for 16-bit frames
+ * @param spi SPI instance
+ * @param tx_buf TX data, NULL to send 0x0000
+ * @param rx_buf RX buffer, NULL to discard
+ * @param len Number of bytes (even)
+ * @param crc Non-zero to append and receive a CRC frame
+ * @param start DWT tick the deadline is measured from
+ * @param budget Cycles allowed for the whole transfer
+ * @return Number of bytes received (less than len on timeout), -EIO
+ *         when only the CRC frame timed out
+ * @note Buffers hold frames as little-endian halfwords, i.e. the native
+ *       uint16_t layout on Cortex-M, and may be unaligned. The bit order
+ *       on the wire is set by SPI_MODE_MSB as for 8-bit frames. Pipelined
+ *       like stm32_spi_xfer8().
  */
-int bsp_spi_init(void)
+static ssize_t stm32_spi_xfer16(SPI_TypeDef *spi, const uint8_t *tx_buf,
+                                uint8_t *rx_buf, size_t len, uint8_t crc,
+                                uint32_t start, uint32_t budget)
 {
-    int ret;
-    uint8_t i;
-    uint32_t pclk_freq;
-    uint32_t max_speed_hz;
-    size_t spi_count;
-    
-    spi_count = sizeof(stm32_spi_hw) / sizeof(stm32_spi_hw[0]);
+    size_t tx_i = 0U;
+    size_t rx_i = 0U;
+    size_t rx_end = len + ((crc != 0U) ? 2U : 0U);
+    uint16_t word;
     
-    for (i = 0U; i < spi_count; i++) {
-        /* Get peripheral clock frequency */
-        pclk_freq = stm32_spi_get_pclk_freq(stm32_spi_hw[i].instance);
-        if (pclk_freq == 0U) {
-            LOG_E("Failed to get PCLK frequency for SPI%u", i + 1U);
-            return -EIO;
-        }
-        
-        stm32_spi_hw[i].pclk_freq = pclk_freq;
-        
-        /* Calculate maximum speed */
-        /* STM32F1: In master mode with polling, max speed is PCLK/2 */
-        /* However, we must also respect datasheet limit (typically 18MHz) */
-        max_speed_hz = pclk_freq >> 1U;  /* PCLK/2 - hardware limit */
-        
-        /* Apply datasheet maximum speed limit */
-        if (max_speed_hz > STM32_SPI_MAX_SPEED_HZ) {
-            max_speed_hz = STM32_SPI_MAX_SPEED_HZ;
-        }
-        
-        stm32_spi_hw[i].max_speed_hz = max_speed_hz;
-        
-        /* Initialize GPIO */
-        ret = stm32_spi_gpio_init(stm32_spi_hw[i].instance);
-        if (ret != 0) {
-            LOG_E("Failed to initialize GPIO for SPI%u", i + 1U);
-            return ret;
+    while (rx_i < rx_end) {
+        if ((tx_i < len) && ((tx_i - rx_i) < 4U) && (LL_SPI_IsActiveFlag_TXE(spi) != 0U)) {
+            if (tx_buf != NULL) {
+                word = (uint16_t)((uint16_t)tx_buf[tx_i] | ((uint16_t)tx_buf[tx_i + 1U] << 8));
+            } else {
+                word = 0x0000U;
+            }
+            LL_SPI_TransmitData16(spi, word);
+            tx_i += 2U;
+            if ((crc != 0U) && (tx_i == len)) {
+                SET_BIT(spi->CR1, SPI_CR1_CRCNEXT);
+            }
+        } else if (LL_SPI_IsActiveFlag_RXNE(spi) != 0U) {
+            word = LL_SPI_ReceiveData16(spi);
+            if ((rx_buf != NULL) && (rx_i < len)) {
+                rx_buf[rx_i]      = (uint8_t)word;
+                rx_buf[rx_i + 1U] = (uint8_t)(word >> 8);
+            }
+            rx_i += 2U;
+        } else if (stm32_spi_expired(start, budget) != 0U) {
+            break;
+        } else {
+            /* Frame still shifting */
         }
-        
-        /* Register controller */
-        ret = spi_controller_register(&stm32_spi_controller[i], 
-                                     stm32_spi_hw[i].name, 
-                                     &stm32_spi_ops);
-        if (ret != 0) {
-            LOG_E("Failed to register SPI controller '%s'", stm32_spi_hw[i].name);
+    }
+    
+    if (rx_i < len) {
+        return (ssize_t)rx_i;
+    }
+    
+    /* All data in but the peer CRC frame missing: nothing was checked */
+    if (rx_i < rx_end) {
+        return -EIO;
+    }
+    
+    return (ssize_t)len;
+}
+
+/**
+ * @brief Program and start both DMA channels for one transfer
+ * @param hw Hardware data pointer
+ * @param tx_buf TX data, NULL to clock out dummy frames (rx-only)
+ * @param rx_buf RX buffer, NULL to discard received frames (tx-only)
+ * @param len Number of bytes, at most 65535 frames
+ * @param frame16 Non-zero for 16-bit frames (halfword-aligned buffers)
+ * @param irq Non-zero to raise the RX channel interrupt on completion/error
+ * @note The RX channel always runs (into a sink when rx_buf is NULL) so
+ *       completion is detected on the last received frame and OVR cannot
+ *       occur.
+ */
+static void stm32_spi_dma_start(struct stm32_spi_hw *hw, const uint8_t *tx_buf,
+                                uint8_t *rx_buf, size_t len, uint8_t frame16, uint8_t irq)
+{
+    static const uint16_t dummy_tx = 0x0000U;
+    static uint16_t dummy_rx;
+    SPI_TypeDef *spi = hw->instance;
+    DMA_TypeDef *dma = hw->dma;
+    uint32_t align;
+    uint32_t frames;
+    
+    if (frame16 != 0U) {
+        align  = LL_DMA_PDATAALIGN_HALFWORD | LL_DMA_MDATAALIGN_HALFWORD;
+        frames = (uint32_t)len >> 1;
+    } else {
+        align  = LL_DMA_PDATAALIGN_BYTE | LL_DMA_MDATAALIGN_BYTE;
+        frames = (uint32_t)len;
+    }
+    
+    LL_DMA_DisableChannel(dma, hw->dma_rx_ch);
+    LL_DMA_DisableChannel(dma, hw->dma_tx_ch);
+    
+    /* The TX DMA end triggers CRCNEXT in hardware */
+    if (hw->crc_active != 0U) {
+        stm32_spi_crc_reset(spi);
+    }
+    
+    LL_DMA_ConfigTransfer(dma, hw->dma_rx_ch,
+                          LL_DMA_DIRECTION_PERIPH_TO_MEMORY | LL_DMA_MODE_NORMAL |
+                          LL_DMA_PERIPH_NOINCREMENT |
+                          ((rx_buf != NULL) ? LL_DMA_MEMORY_INCREMENT : LL_DMA_MEMORY_NOINCREMENT) |
+                          align | LL_DMA_PRIORITY_HIGH);
+    LL_DMA_ConfigAddresses(dma, hw->dma_rx_ch, LL_SPI_DMA_GetRegAddr(spi),
+                           (rx_buf != NULL) ? (uint32_t)rx_buf : (uint32_t)&dummy_rx,
+                           LL_DMA_DIRECTION_PERIPH_TO_MEMORY);
+    LL_DMA_SetDataLength(dma, hw->dma_rx_ch, frames);
+    
+    LL_DMA_ConfigTransfer(dma, hw->dma_tx_ch,
+                          LL_DMA_DIRECTION_MEMORY_TO_PERIPH | LL_DMA_MODE_NORMAL |
+                          LL_DMA_PERIPH_NOINCREMENT |
+                          ((tx_buf != NULL) ? LL_DMA_MEMORY_INCREMENT : LL_DMA_MEMORY_NOINCREMENT) |
+                          align | LL_DMA_PRIORITY_MEDIUM);
+    LL_DMA_ConfigAddresses(dma, hw->dma_tx_ch,
+                           (tx_buf != NULL) ? (uint32_t)tx_buf : (uint32_t)&dummy_tx,
+                           LL_SPI_DMA_GetRegAddr(spi), LL_DMA_DIRECTION_MEMORY_TO_PERIPH);
+    LL_DMA_SetDataLength(dma, hw->dma_tx_ch, frames);
+    
+    dma->IFCR = STM32_DMA_FLAG(hw->dma_rx_ch, DMA_IFCR_CGIF1) |
+                STM32_DMA_FLAG(hw->dma_tx_ch, DMA_IFCR_CGIF1);
+    
+    /* Drop a stale frame so RX starts aligned with TX */
+    if (LL_SPI_IsActiveFlag_RXNE(spi) != 0U) {
+        (void)LL_SPI_ReceiveData16(spi);
+    }
+    
+    if (irq != 0U) {
+        LL_DMA_EnableIT_TC(dma, hw->dma_rx_ch);
+        LL_DMA_EnableIT_TE(dma, hw->dma_rx_ch);
+    } else {
+        LL_DMA_DisableIT_TC(dma, hw->dma_rx_ch);
+        LL_DMA_DisableIT_TE(dma, hw->dma_rx_ch);
+    }
+    
+    /* RX first, TX request last: the first TX request starts the clock */
+    LL_SPI_EnableDMAReq_RX(spi);
+    LL_DMA_EnableChannel(dma, hw->dma_rx_ch);
+    LL_DMA_EnableChannel(dma, hw->dma_tx_ch);
+    LL_SPI_EnableDMAReq_TX(spi);
+}
+
+/**
+ * @brief Stop both DMA channels after a transfer
+ * @param hw Hardware data pointer
+ */
+static void stm32_spi_dma_stop(struct stm32_spi_hw *hw)
+{
+    SPI_TypeDef *spi = hw->instance;
+    DMA_TypeDef *dma = hw->dma;
+    
+    LL_SPI_DisableDMAReq_TX(spi);
+    LL_DMA_DisableChannel(dma, hw->dma_tx_ch);
+    LL_DMA_DisableChannel(dma, hw->dma_rx_ch);
+    LL_SPI_DisableDMAReq_RX(spi);
+    
+    dma->IFCR = STM32_DMA_FLAG(hw->dma_rx_ch, DMA_IFCR_CGIF1) |
+                STM32_DMA_FLAG(hw->dma_tx_ch, DMA_IFCR_CGIF1);
+}
+
+/**
+ * @brief Execute a transfer with DMA
+ * @param hw Hardware data pointer
+ * @param tx_buf TX data, NULL to clock out dummy frames (rx-only)
+ * @param rx_buf RX buffer, NULL to discard received frames (tx-only)
+ * @param len Number of bytes, at most 65535 frames
+ * @param frame16 Non-zero for 16-bit frames (halfword-aligned buffers)
+ * @return Number of bytes transferred on success, error code on failure
+ * @note Completion is polled on the DMA flags, no interrupt is used.
+ */
+static ssize_t stm32_spi_transfer_dma(struct stm32_spi_hw *hw, const uint8_t *tx_buf,
+                                      uint8_t *rx_buf, size_t len, uint8_t frame16)
+{
+    SPI_TypeDef *spi = hw->instance;
+    DMA_TypeDef *dma = hw->dma;
+    uint32_t start;
+    uint32_t budget;
+    uint32_t isr;
+    ssize_t ret = (ssize_t)len;
+    
+    stm32_spi_dma_start(hw, tx_buf, rx_buf, len, frame16, 0U);
+    
+    budget = ((uint32_t)len + 2U) * hw->cycles_per_byte * 2U + STM32_SPI_TIMEOUT_SLACK_CYCLES;
+    start  = BSP_DWT_GetTick();
+    for (;;) {
+        isr = dma->ISR;
+        if ((isr & STM32_DMA_FLAG(hw->dma_rx_ch, DMA_ISR_TCIF1)) != 0U) {
+            break;
+        }
+        if ((isr & (STM32_DMA_FLAG(hw->dma_rx_ch, DMA_ISR_TEIF1) |
+                    STM32_DMA_FLAG(hw->dma_tx_ch, DMA_ISR_TEIF1))) != 0U) {
+            LOG_E("%s: DMA transfer error", hw->name);
+            ret = -EIO;
+            break;
+        }
+        if (stm32_spi_expired(start, budget) != 0U) {
+            LOG_E("%s: DMA transfer timeout", hw->name);
+            ret = -EIO;
+            break;
+        }
+#if defined(USING_FREERTOS) || defined(configUSE_MUTEXES)
+        taskYIELD();
+#endif
+    }
+    
+    if ((ret >= 0) && (hw->crc_active != 0U)) {
+        ret = stm32_spi_crc_finish(hw, start, budget);
+        if (ret == 0) {
+            ret = (ssize_t)len;
+        }
+    }
+    
+    stm32_spi_dma_stop(hw);
+    
+    /* Last frame received means the bus is idle, BSY clears right away */
+    while (LL_SPI_IsActiveFlag_BSY(spi) != 0U) {
+        if (stm32_spi_expired(start, budget) != 0U) {
+            return -EIO;
+        }
+    }
+    
+    if (LL_SPI_IsActiveFlag_OVR(spi) != 0U) {
+        LL_SPI_ClearFlag_OVR(spi);
+        return -EIO;
+    }
+    
+    return ret;
+}
+
+/**
+ * @brief Find a controller by name
+ * @param bus Controller name
+ * @return Hardware data pointer, NULL if not found
+ */
+static struct stm32_spi_hw *stm32_spi_find(const char *bus)
+{
+    size_t i;
+    
+    if (bus == NULL) {
+        return NULL;
+    }
+    
+    for (i = 0U; i < sizeof(stm32_spi_hw) / sizeof(stm32_spi_hw[0]); i++) {
+        if (strcmp(stm32_spi_hw[i].name, bus) == 0) {
+            return &stm32_spi_hw[i];
+        }
+    }
+    
+    return NULL;
+}
+
+/**
+ * @brief Drive the async queue forward
+ * @param hw Hardware data pointer
+ * @note Starts the next transfer of async_cur. With DMA it returns once
+ *       the channels run and the interrupt continues from there, whatever
+ *       the transfer length, so nothing is polled in interrupt context.
+ *       Without DMA it executes the whole queue in the calling context.
+ *       Only one context drives the queue at a time; a submit from a
+ *       completion callback just makes the message async_cur and the
+ *       running loop picks it up.
+ */
+static void stm32_spi_async_run(struct stm32_spi_hw *hw)
+{
+    struct bsp_spi_msg *msg;
+    struct bsp_spi_xfer *xfer;
+    uint32_t level;
+    int ret;
+    
+    level = __get_PRIMASK();
+    __disable_irq();
+    if (hw->async_busy != 0U) {
+        __set_PRIMASK(level);
+        return;
+    }
+    hw->async_busy = 1U;
+    __set_PRIMASK(level);
+    
+    for (;;) {
+        /* Release the queue in the same critical section that finds it
+         * empty, so a message submitted meanwhile is never stranded */
+        level = __get_PRIMASK();
+        __disable_irq();
+        msg = hw->async_cur;
+        if (msg == NULL) {
+            hw->async_busy = 0U;
+        }
+        __set_PRIMASK(level);
+        
+        if (msg == NULL) {
+            return;
+        }
+        
+        if (msg->idx == 0U) {
+            ret = stm32_spi_configure(hw, msg->dev);
+            if (ret != 0) {
+                stm32_spi_async_xfer_done(hw, ret);
+                continue;
+            }
+            hw->async_frame16 = (msg->dev->bits_per_word == 16U) ? 1U : 0U;
+            stm32_spi_set_cs(hw->ctrl, msg->dev, 1U);
+            hw->async_cs = 1U;
+        }
+        
+        xfer = &msg->xfers[msg->idx];
+        if (hw->dma != NULL) {
+            /* Same deadline as a synchronous DMA transfer, checked by the watchdog */
+            hw->async_budget = ((uint32_t)xfer->len + 2U) * hw->cycles_per_byte * 2U +
+                               STM32_SPI_TIMEOUT_SLACK_CYCLES;
+            hw->async_start  = BSP_DWT_GetTick();
+            hw->async_armed  = 1U;
+            stm32_spi_dma_start(hw, xfer->tx_buf, xfer->rx_buf, xfer->len, hw->async_frame16, 1U);
+            return;
+        }
+        
+        stm32_spi_async_xfer_done(hw, stm32_spi_transfer_poll(hw, xfer->tx_buf, xfer->rx_buf,
+                                                              xfer->len, hw->async_frame16));
+    }
+}
+
+/**
+ * @brief Account a finished transfer of async_cur
+ * @param hw Hardware data pointer
+ * @param ret Transfer result
+ * @note Handles CS between and after transfers. When the message is done
+ *       it is marked done and the next queued message becomes async_cur
+ *       before the callback runs, so the callback sees a final status and
+ *       may resubmit.
+ */
+static void stm32_spi_async_xfer_done(struct stm32_spi_hw *hw, ssize_t ret)
+{
+    struct bsp_spi_msg *msg = hw->async_cur;
+    struct bsp_spi_xfer *xfer = &msg->xfers[msg->idx];
+    bsp_spi_complete_t complete = msg->complete;
+    void *arg = msg->arg;
+    uint32_t level;
+#if defined(USING_FREERTOS) || defined(configUSE_MUTEXES)
+    BaseType_t woken = pdFALSE;
+    TaskHandle_t waiter;
+#endif
+    
+    if (ret < 0) {
+        msg->status = (int)ret;
+    } else if ((size_t)ret != xfer->len) {
+        msg->actual_len += (size_t)ret;
+        msg->status = -EIO;
+    } else {
+        msg->actual_len += (size_t)ret;
+        msg->idx++;
+        if (msg->idx < msg->num) {
+            if (xfer->cs_change != 0U) {
+                stm32_spi_set_cs(hw->ctrl, msg->dev, 0U);
+                stm32_spi_set_cs(hw->ctrl, msg->dev, 1U);
+            }
+            return;
+        }
+        msg->status = 0;
+    }
+    
+    /* A failed message always releases CS, whichever transfer failed */
+    if ((hw->async_cs != 0U) && ((msg->status != 0) || (xfer->cs_change == 0U))) {
+        stm32_spi_set_cs(hw->ctrl, msg->dev, 0U);
+    } else if (hw->async_cs != 0U) {
+        hw->cs_held = msg->dev;
+    }
+    hw->async_cs = 0U;
+    
+    /* The waiter cannot run before it is read, the message may be gone after */
+    level = __get_PRIMASK();
+    __disable_irq();
+    msg->done = 1U;
+#if defined(USING_FREERTOS) || defined(configUSE_MUTEXES)
+    waiter = (TaskHandle_t)msg->waiter;
+#endif
+    hw->async_cur = hw->async_head;
+    if (hw->async_head != NULL) {
+        hw->async_head = hw->async_head->next;
+        if (hw->async_head == NULL) {
+            hw->async_tail = NULL;
+        }
+    }
+    __set_PRIMASK(level);
+    
+#if defined(USING_FREERTOS) || defined(configUSE_MUTEXES)
+    /* Reached from the DMA interrupt, or from task context on the polled
+     * path and when the watchdog fails a stalled transfer */
+    if (waiter != NULL) {
+        if (__get_IPSR() != 0U) {
+            vTaskNotifyGiveFromISR(waiter, &woken);
+            portYIELD_FROM_ISR(woken);
+        } else {
+            (void)xTaskNotifyGive(waiter);
+        }
+    }
+#endif
+    
+    if (complete != NULL) {
+        complete(msg, arg);
+    }
+}
+
+/**
+ * @brief RX DMA channel interrupt, chains the async queue
+ * @param hw Hardware data pointer
+ */
+static void stm32_spi_dma_irq(struct stm32_spi_hw *hw)
+{
+    SPI_TypeDef *spi = hw->instance;
+    DMA_TypeDef *dma = hw->dma;
+    struct bsp_spi_msg *msg = hw->async_cur;
+    uint32_t isr = dma->ISR;
+    uint32_t timeout;
+    ssize_t ret;
+    
+    if ((isr & STM32_DMA_FLAG(hw->dma_rx_ch, DMA_ISR_TEIF1)) != 0U) {
+        ret = -EIO;
+    } else if ((isr & STM32_DMA_FLAG(hw->dma_rx_ch, DMA_ISR_TCIF1)) != 0U) {
+        ret = 0;
+    } else {
+        return;
+    }
+    
+    if ((ret == 0) && (hw->crc_active != 0U)) {
+        ret = stm32_spi_crc_finish(hw, BSP_DWT_GetTick(),
+                                   4U * hw->cycles_per_byte + STM32_SPI_TIMEOUT_SLACK_CYCLES);
+    }
+    
+    stm32_spi_dma_stop(hw);
+    LL_DMA_DisableIT_TC(dma, hw->dma_rx_ch);
+    LL_DMA_DisableIT_TE(dma, hw->dma_rx_ch);
+    hw->async_armed = 0U;
+    
+    if (msg == NULL) {
+        return;
+    }
+    
+    if (ret == 0) {
+        /* Last frame is in, BSY clears within a couple of PCLK cycles */
+        timeout = 1000U;
+        while ((LL_SPI_IsActiveFlag_BSY(spi) != 0U) && (timeout > 0U)) {
+            timeout--;
+        }
+        if (LL_SPI_IsActiveFlag_OVR(spi) != 0U) {
+            LL_SPI_ClearFlag_OVR(spi);
+            ret = -EIO;
+        } else {
+            ret = (ssize_t)msg->xfers[msg->idx].len;
+        }
+    }
+    
+    /* The transfer that held the queue is over, keep driving it from here */
+    stm32_spi_async_xfer_done(hw, ret);
+    hw->async_busy = 0U;
+    stm32_spi_async_run(hw);
+}
+
+/**
+ * @brief Abort an async DMA transfer that overran its deadline
+ * @param hw Hardware data pointer
+ * @note A lost DMA completion would otherwise leave the message and
+ *       everything queued behind it pending forever. The transfer is
+ *       stopped and its message completed with -EIO, then the queue
+ *       moves on.
+ */
+static void stm32_spi_async_watchdog(struct stm32_spi_hw *hw)
+{
+    uint32_t level;
+    
+    if (hw->dma == NULL) {
+        return;
+    }
+    
+    level = __get_PRIMASK();
+    __disable_irq();
+    if ((hw->async_armed == 0U) || (hw->async_cur == NULL) ||
+        (stm32_spi_expired(hw->async_start, hw->async_budget) == 0U)) {
+        __set_PRIMASK(level);
+        return;
+    }
+    stm32_spi_dma_stop(hw);
+    LL_DMA_DisableIT_TC(hw->dma, hw->dma_rx_ch);
+    LL_DMA_DisableIT_TE(hw->dma, hw->dma_rx_ch);
+    hw->async_armed = 0U;
+    __set_PRIMASK(level);
+    
+    /* async_busy is still set, nothing else touches async_cur meanwhile */
+    LOG_E("%s: async DMA transfer timeout", hw->name);
+    stm32_spi_async_xfer_done(hw, -EIO);
+    hw->async_busy = 0U;
+    stm32_spi_async_run(hw);
+}
+
+/**
+ * @brief Pulse the RCC reset of a SPI peripheral
+ * @param spi SPI instance
+ * @note The only way on F1 to drop a byte already loaded into the TX buffer.
+ */
+static void stm32_spi_periph_reset(SPI_TypeDef *spi)
+{
+#if defined(BSP_USING_SPI1)
+    if (spi == SPI1) {
+        LL_APB2_GRP1_ForceReset(LL_APB2_GRP1_PERIPH_SPI1);
+        LL_APB2_GRP1_ReleaseReset(LL_APB2_GRP1_PERIPH_SPI1);
+    }
+#endif
+#if defined(BSP_USING_SPI2)
+    if (spi == SPI2) {
+        LL_APB1_GRP1_ForceReset(LL_APB1_GRP1_PERIPH_SPI2);
+        LL_APB1_GRP1_ReleaseReset(LL_APB1_GRP1_PERIPH_SPI2);
+    }
+#endif
+#if defined(BSP_USING_SPI3)
+    if (spi == SPI3) {
+        LL_APB1_GRP1_ForceReset(LL_APB1_GRP1_PERIPH_SPI3);
+        LL_APB1_GRP1_ReleaseReset(LL_APB1_GRP1_PERIPH_SPI3);
+    }
+#endif
+}
+
+/**
+ * @brief Switch the SPI pins to slave directions
+ * @param spi SPI instance
+ * @note SCK and MOSI become inputs, MISO the alternate function output.
+ */
+static void stm32_spi_gpio_slave(SPI_TypeDef *spi)
+{
+    LL_GPIO_InitTypeDef gpio_init = {0};
+    
+    gpio_init.Speed = LL_GPIO_SPEED_FREQ_HIGH;
+    gpio_init.OutputType = LL_GPIO_OUTPUT_PUSHPULL;
+    
+#if defined(BSP_USING_SPI1)
+    if (spi == SPI1) {
+        gpio_init.Mode = LL_GPIO_MODE_FLOATING;
+        gpio_init.Pin = BSP_SPI1_SCK_PIN;
+        LL_GPIO_Init(BSP_SPI1_SCK_PORT, &gpio_init);
+        gpio_init.Pin = BSP_SPI1_MOSI_PIN;
+        LL_GPIO_Init(BSP_SPI1_MOSI_PORT, &gpio_init);
+        gpio_init.Mode = LL_GPIO_MODE_ALTERNATE;
+        gpio_init.Pin = BSP_SPI1_MISO_PIN;
+        LL_GPIO_Init(BSP_SPI1_MISO_PORT, &gpio_init);
+    }
+#endif
+#if defined(BSP_USING_SPI2)
+    if (spi == SPI2) {
+        gpio_init.Mode = LL_GPIO_MODE_FLOATING;
+        gpio_init.Pin = BSP_SPI2_SCK_PIN;
+        LL_GPIO_Init(BSP_SPI2_SCK_PORT, &gpio_init);
+        gpio_init.Pin = BSP_SPI2_MOSI_PIN;
+        LL_GPIO_Init(BSP_SPI2_MOSI_PORT, &gpio_init);
+        gpio_init.Mode = LL_GPIO_MODE_ALTERNATE;
+        gpio_init.Pin = BSP_SPI2_MISO_PIN;
+        LL_GPIO_Init(BSP_SPI2_MISO_PORT, &gpio_init);
+    }
+#endif
+#if defined(BSP_USING_SPI3)
+    if (spi == SPI3) {
+        gpio_init.Mode = LL_GPIO_MODE_FLOATING;
+        gpio_init.Pin = BSP_SPI3_SCK_PIN;
+        LL_GPIO_Init(BSP_SPI3_SCK_PORT, &gpio_init);
+        gpio_init.Pin = BSP_SPI3_MOSI_PIN;
+        LL_GPIO_Init(BSP_SPI3_MOSI_PORT, &gpio_init);
+        gpio_init.Mode = LL_GPIO_MODE_ALTERNATE;
+        gpio_init.Pin = BSP_SPI3_MISO_PIN;
+        LL_GPIO_Init(BSP_SPI3_MISO_PORT, &gpio_init);
+    }
+#endif
+}
+
+/**
+ * @brief Program the slave and arm the TX response for the next frame
+ * @param hw Hardware data pointer
+ * @note Called with NSS high. The peripheral is reset first so no stale
+ *       byte of the previous response is left in the TX buffer; the
+ *       circular RX channel keeps running and just sees no requests.
+ */
+static void stm32_spi_slave_arm(struct stm32_spi_hw *hw)
+{
+    struct stm32_spi_slave *sl = &hw->slave;
+    SPI_TypeDef *spi = hw->instance;
+    DMA_TypeDef *dma = hw->dma;
+    
+    stm32_spi_periph_reset(spi);
+    spi->CR1 = sl->cr1;
+    
+    LL_DMA_DisableChannel(dma, hw->dma_tx_ch);
+    dma->IFCR = STM32_DMA_FLAG(hw->dma_tx_ch, DMA_IFCR_CGIF1);
+    
+    sl->tx_cur_len = 0U;
+    if (sl->tx_next != NULL) {
+        LL_DMA_ConfigTransfer(dma, hw->dma_tx_ch,
+                              LL_DMA_DIRECTION_MEMORY_TO_PERIPH | LL_DMA_MODE_NORMAL |
+                              LL_DMA_PERIPH_NOINCREMENT | LL_DMA_MEMORY_INCREMENT |
+                              LL_DMA_PDATAALIGN_BYTE | LL_DMA_MDATAALIGN_BYTE | LL_DMA_PRIORITY_MEDIUM);
+        LL_DMA_ConfigAddresses(dma, hw->dma_tx_ch, (uint32_t)sl->tx_next,
+                               LL_SPI_DMA_GetRegAddr(spi), LL_DMA_DIRECTION_MEMORY_TO_PERIPH);
+        LL_DMA_SetDataLength(dma, hw->dma_tx_ch, sl->tx_next_len);
+        LL_DMA_EnableChannel(dma, hw->dma_tx_ch);
+        sl->tx_cur_len = sl->tx_next_len;
+        sl->tx_next = NULL;
+        spi->CR2 = SPI_CR2_RXDMAEN | SPI_CR2_TXDMAEN;
+    } else {
+        spi->CR2 = SPI_CR2_RXDMAEN;
+    }
+    
+    spi->CR1 = (uint32_t)sl->cr1 | SPI_CR1_SPE;
+}
+
+/**
+ * @brief NSS rising edge: end of frame
+ * @param args Hardware data pointer
+ * @note Hands the frame to the callback straight from the ring, in two
+ *       segments when it wraps, then re-arms for the next frame.
+ */
+static void stm32_spi_slave_nss_isr(void *args)
+{
+    struct stm32_spi_hw *hw = (struct stm32_spi_hw *)args;
+    struct stm32_spi_slave *sl = &hw->slave;
+    SPI_TypeDef *spi = hw->instance;
+    uint32_t timeout;
+    uint32_t tc_flag;
+    uint8_t wrapped;
+    uint16_t pos;
+    size_t len;
+    size_t first;
+    
+    if (sl->active == 0U) {
+        return;
+    }
+    
+    /* The DMA picks up the last byte within a few bus cycles */
+    timeout = 100U;
+    while ((LL_SPI_IsActiveFlag_RXNE(spi) != 0U) && (timeout > 0U)) {
+        timeout--;
+    }
+    
+    pos = (uint16_t)(sl->ring_size - LL_DMA_GetDataLength(hw->dma, hw->dma_rx_ch));
+    if (pos == sl->ring_size) {
+        pos = 0U;
+    }
+    
+    /* TC is left polled: it tells whether the frame passed the end of the
+     * ring, which pos alone cannot for a frame of exactly ring_size */
+    tc_flag = STM32_DMA_FLAG(hw->dma_rx_ch, DMA_ISR_TCIF1);
+    wrapped = ((hw->dma->ISR & tc_flag) != 0U) ? 1U : 0U;
+    hw->dma->IFCR = STM32_DMA_FLAG(hw->dma_rx_ch, DMA_IFCR_CTCIF1);
+    
+    if (pos > sl->frame_start) {
+        len = (size_t)(pos - sl->frame_start);
+    } else if ((pos < sl->frame_start) || (wrapped != 0U)) {
+        len = (size_t)(sl->ring_size - sl->frame_start + pos);
+    } else {
+        len = 0U;
+    }
+    
+    /* Wrapped without ending before frame_start: the ring was lapped and
+     * the start of the frame overwritten */
+    if ((wrapped != 0U) && (pos > sl->frame_start)) {
+        sl->stats.rx_overflow++;
+        len = 0U;
+    }
+    
+    if (LL_SPI_IsActiveFlag_OVR(spi) != 0U) {
+        sl->stats.rx_overrun++;
+    }
+    if ((sl->tx_cur_len != 0U) && (len > sl->tx_cur_len)) {
+        sl->stats.tx_underrun++;
+    }
+    
+    if (len != 0U) {
+        sl->stats.frames++;
+        sl->stats.rx_bytes += (uint32_t)len;
+        if (sl->frame_cb != NULL) {
+            first = (size_t)(sl->ring_size - sl->frame_start);
+            if (len <= first) {
+                sl->frame_cb(&sl->ring[sl->frame_start], len, NULL, 0U, sl->arg);
+            } else {
+                sl->frame_cb(&sl->ring[sl->frame_start], first, sl->ring, len - first, sl->arg);
+            }
+        }
+    }
+    sl->frame_start = pos;
+    
+    stm32_spi_slave_arm(hw);
+}
+
+/**
+ * @brief SPI controller operations
+ */
+static const struct spi_controller_ops stm32_spi_ops = {
+    .setup = stm32_spi_setup,
+    .set_cs = stm32_spi_set_cs,
+    .transfer_one = stm32_spi_transfer_one,
+};
+
+/**
+ * @brief Get peripheral clock frequency for SPI
+ * @param spi_instance SPI peripheral instance
+ * @return Clock frequency in Hz, 0 on error
+ * @note Uses LL library macros for cleaner implementation
+ */
+static uint32_t stm32_spi_get_pclk_freq(SPI_TypeDef *spi_instance)
+{
+    uint32_t hclk_freq;
+    uint32_t apb_prescaler;
+    
+    if (spi_instance == NULL) {
+        return 0U;
+    }
+    
+    /* Get HCLK frequency (SystemCoreClock) */
+    hclk_freq = SystemCoreClock;
+    
+#if defined(BSP_USING_SPI1)
+    if (spi_instance == SPI1) {
+        /* SPI1 is on APB2 */
+        apb_prescaler = LL_RCC_GetAPB2Prescaler();
+        /* Use LL library macro to calculate PCLK2 frequency */
+        return __LL_RCC_CALC_PCLK2_FREQ(hclk_freq, apb_prescaler);
+    }
+#endif
+    
+#if defined(BSP_USING_SPI2) || defined(BSP_USING_SPI3)
+    if ((spi_instance == SPI2) || (spi_instance == SPI3)) {
+        /* SPI2/3 are on APB1 */
+        apb_prescaler = LL_RCC_GetAPB1Prescaler();
+        /* Use LL library macro to calculate PCLK1 frequency */
+        return __LL_RCC_CALC_PCLK1_FREQ(hclk_freq, apb_prescaler);
+    }
+#endif
+    
+    return 0U;
+}
+
+/**
+ * @brief Refresh the clock figures of a controller
+ * @param hw Hardware data pointer
+ * @return 0 on success, error code on failure
+ */
+static int stm32_spi_update_clock(struct stm32_spi_hw *hw)
+{
+    uint32_t pclk_freq;
+    uint32_t max_speed_hz;
+    
+    pclk_freq = stm32_spi_get_pclk_freq(hw->instance);
+    if (pclk_freq == 0U) {
+        return -EIO;
+    }
+    
+    hw->pclk_freq = pclk_freq;
+    
+    /* Calculate maximum speed */
+    /* STM32F1: In master mode with polling, max speed is PCLK/2 */
+    /* However, we must also respect datasheet limit (typically 18MHz) */
+    max_speed_hz = pclk_freq >> 1U;  /* PCLK/2 - hardware limit */
+    
+    /* Apply datasheet maximum speed limit */
+    if (max_speed_hz > STM32_SPI_MAX_SPEED_HZ) {
+        max_speed_hz = STM32_SPI_MAX_SPEED_HZ;
+    }
+    
+    hw->max_speed_hz = max_speed_hz;
+    
+    return 0;
+}
+
+/**
+ * @brief Re-derive SPI timings after a bus clock change
+ * @return 0 on success, error code on failure
+ */
+int bsp_spi_clock_changed(void)
+{
+    struct stm32_spi_hw *hw;
+    struct stm32_spi_cfg *cfg;
+    struct stm32_spi_cfg tmp;
+    const struct spi_device *dev;
+    uint32_t i;
+    uint32_t j;
+    uint32_t level;
+    int ret;
+    int err = 0;
+    
+    for (i = 0U; i < sizeof(stm32_spi_hw) / sizeof(stm32_spi_hw[0]); i++) {
+        hw = &stm32_spi_hw[i];
+        
+        ret = stm32_spi_update_clock(hw);
+        if (ret != 0) {
+            err = ret;
+            continue;
+        }
+        
+        /* Rebuild every cached image, drop the ones no longer valid. The
+         * image is built aside and swapped in with interrupts masked, so a
+         * transfer or async message never programs a half-written slot. */
+        for (j = 0U; j < BSP_SPI_CFG_CACHE_SIZE; j++) {
+            cfg = &hw->cfg_cache[j];
+            dev = cfg->dev;
+            if (dev == NULL) {
+                continue;
+            }
+            ret = stm32_spi_build_cfg(hw, dev, &tmp);
+            level = __get_PRIMASK();
+            __disable_irq();
+            if (cfg->dev == dev) {
+                if (ret == 0) {
+                    *cfg = tmp;
+                } else {
+                    cfg->dev = NULL;
+                    if (hw->cur_cfg == cfg) {
+                        hw->cur_cfg = NULL;
+                    }
+                }
+            }
+            __set_PRIMASK(level);
+        }
+        
+        /* Idle bus: move the selected device to its new divider right away.
+         * Otherwise (async queue, synchronous transfer or a frame still
+         * shifting) the next setup or async message picks it up. */
+        level = __get_PRIMASK();
+        __disable_irq();
+        if ((hw->cur_cfg != NULL) && (hw->cur_cfg->dev != NULL) &&
+            (hw->async_cur == NULL) && (hw->async_busy == 0U) &&
+            (hw->sync_busy == 0U) && (hw->slave.active == 0U) &&
+            (LL_SPI_IsActiveFlag_BSY(hw->instance) == 0U)) {
+            (void)stm32_spi_configure(hw, hw->cur_cfg->dev);
+        }
+        __set_PRIMASK(level);
+    }
+    
+    return err;
+}
+
+/**
+ * @brief Report the SCK rate a device gets
+ * @param bus Controller name
+ * @param dev Device
+ * @param requested_hz Output, requested rate after clamping to the controller limit
+ * @param actual_hz Output, achieved rate
+ * @return 0 on success, error code on failure
+ */
+int bsp_spi_get_speed(const char *bus, const struct spi_device *dev,
+                      uint32_t *requested_hz, uint32_t *actual_hz)
+{
+    struct stm32_spi_hw *hw;
+    struct stm32_spi_cfg tmp;
+    const struct stm32_spi_cfg *cfg = NULL;
+    uint32_t i;
+    int ret;
+    
+    hw = stm32_spi_find(bus);
+    if (hw == NULL) {
+        return -ENODEV;
+    }
+    
+    if ((dev == NULL) || (requested_hz == NULL) || (actual_hz == NULL)) {
+        return -EINVAL;
+    }
+    
+    for (i = 0U; i < BSP_SPI_CFG_CACHE_SIZE; i++) {
+        if ((hw->cfg_cache[i].dev == dev) &&
+            (hw->cfg_cache[i].max_speed_hz == dev->max_speed_hz)) {
+            cfg = &hw->cfg_cache[i];
+            break;
+        }
+    }
+    
+    if (cfg == NULL) {
+        ret = stm32_spi_build_cfg(hw, dev, &tmp);
+        if (ret != 0) {
+            return ret;
+        }
+        cfg = &tmp;
+    }
+    
+    *requested_hz = cfg->requested_hz;
+    *actual_hz    = cfg->actual_speed_hz;
+    
+    return 0;
+}
+
+/**
+ * @brief Enable or disable hardware CRC for a device
+ * @param bus Controller name ("spi1", ...)
+ * @param dev Device
+ * @param poly CRC polynomial, 0 to disable
+ * @return 0 on success, error code on failure
+ */
+int bsp_spi_set_crc(const char *bus, const struct spi_device *dev, uint16_t poly)
+{
+    struct stm32_spi_hw *hw;
+    struct stm32_spi_crc_dev *slot = NULL;
+    uint32_t i;
+    
+    hw = stm32_spi_find(bus);
+    if (hw == NULL) {
+        return -ENODEV;
+    }
+    
+    if (dev == NULL) {
+        return -EINVAL;
+    }
+    
+    for (i = 0U; i < BSP_SPI_CRC_DEVICES; i++) {
+        if (hw->crc_devs[i].dev == dev) {
+            slot = &hw->crc_devs[i];
+            break;
+        }
+        if ((slot == NULL) && (hw->crc_devs[i].dev == NULL)) {
+            slot = &hw->crc_devs[i];
+        }
+    }
+    
+    if (poly == 0U) {
+        if ((slot != NULL) && (slot->dev == dev)) {
+            slot->dev = NULL;
+        }
+    } else if (slot == NULL) {
+        return -ENOSPC;
+    } else {
+        slot->dev  = dev;
+        slot->poly = poly;
+    }
+    
+    /* Force the next setup of this device to rebuild its image */
+    for (i = 0U; i < BSP_SPI_CFG_CACHE_SIZE; i++) {
+        if (hw->cfg_cache[i].dev == dev) {
+            hw->cfg_cache[i].dev = NULL;
+        }
+    }
+    
+    return 0;
+}
+
+/**
+ * @brief Queue a message on a controller
+ * @param bus Controller name ("spi1", ...)
+ * @param msg Message
+ * @return 0 when queued, error code on failure
+ */
+int bsp_spi_async_submit(const char *bus, struct bsp_spi_msg *msg)
+{
+    struct stm32_spi_hw *hw;
+    struct bsp_spi_xfer *xfer;
+    uint32_t level;
+    uint32_t i;
+    uint8_t frame16;
+    uint8_t start = 0U;
+    
+    hw = stm32_spi_find(bus);
+    if (hw == NULL) {
+        return -ENODEV;
+    }
+    
+    if ((msg == NULL) || (msg->dev == NULL) || (msg->xfers == NULL) || (msg->num == 0U)) {
+        return -EINVAL;
+    }
+    
+    frame16 = (msg->dev->bits_per_word == 16U) ? 1U : 0U;
+    for (i = 0U; i < msg->num; i++) {
+        xfer = &msg->xfers[i];
+        if ((xfer->len == 0U) || ((frame16 != 0U) && ((xfer->len & 1U) != 0U))) {
+            return -EINVAL;
+        }
+        /* On a DMA controller every async transfer runs on the DMA */
+        if ((hw->dma != NULL) &&
+            (((xfer->len >> frame16) > 0xFFFFU) ||
+             ((frame16 != 0U) && ((((uintptr_t)xfer->tx_buf | (uintptr_t)xfer->rx_buf) & 1U) != 0U)))) {
+            return -EINVAL;
+        }
+    }
+    
+    /* Recover the queue from a transfer whose DMA completion got lost */
+    stm32_spi_async_watchdog(hw);
+    
+    msg->status     = 0;
+    msg->actual_len = 0U;
+    msg->done       = 0U;
+    msg->idx        = 0U;
+    msg->waiter     = NULL;
+    msg->next       = NULL;
+    
+    level = __get_PRIMASK();
+    __disable_irq();
+    if ((hw->sync_busy != 0U) || (hw->slave.active != 0U)) {
+        /* A synchronous transfer or the slave owns CR1 and CS */
+        __set_PRIMASK(level);
+        return -EBUSY;
+    }
+    if (hw->async_cur == NULL) {
+        hw->async_cur = msg;
+        start = 1U;
+    } else if (hw->async_tail != NULL) {
+        hw->async_tail->next = msg;
+        hw->async_tail = msg;
+    } else {
+        hw->async_head = msg;
+        hw->async_tail = msg;
+    }
+    __set_PRIMASK(level);
+    
+    if (start != 0U) {
+        stm32_spi_async_run(hw);
+    }
+    
+    return 0;
+}
+
+/**
+ * @brief Remove a message that has not started yet
+ * @param bus Controller name
+ * @param msg Message
+ * @return 0 when removed, -EBUSY when in flight or done, error code on failure
+ */
+int bsp_spi_async_cancel(const char *bus, struct bsp_spi_msg *msg)
+{
+    struct stm32_spi_hw *hw;
+    struct bsp_spi_msg *prev = NULL;
+    struct bsp_spi_msg *it;
+    uint32_t level;
+    int ret = -EBUSY;
+    
+    hw = stm32_spi_find(bus);
+    if (hw == NULL) {
+        return -ENODEV;
+    }
+    
+    if (msg == NULL) {
+        return -EINVAL;
+    }
+    
+    level = __get_PRIMASK();
+    __disable_irq();
+    for (it = hw->async_head; it != NULL; prev = it, it = it->next) {
+        if (it == msg) {
+            if (prev == NULL) {
+                hw->async_head = it->next;
+            } else {
+                prev->next = it->next;
+            }
+            if (hw->async_tail == it) {
+                hw->async_tail = prev;
+            }
+            it->next = NULL;
+            ret = 0;
+            break;
+        }
+    }
+    __set_PRIMASK(level);
+    
+    return ret;
+}
+
+/**
+ * @brief Wait for a message to complete
+ * @param msg Message
+ * @param timeout_ms Maximum wait in milliseconds
+ * @return Message status, -EAGAIN on timeout
+ * @note The caller sleeps on its task notification once the scheduler
+ *       runs, and in WFI otherwise. A transfer past its deadline is
+ *       aborted here and its message completes with -EIO.
+ */
+int bsp_spi_async_wait(struct bsp_spi_msg *msg, uint32_t timeout_ms)
+{
+    uint32_t tick_start;
+    uint32_t level;
+    size_t i;
+    
+    if (msg == NULL) {
+        return -EINVAL;
+    }
+    
+#if defined(USING_FREERTOS) || defined(configUSE_MUTEXES)
+    if (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING) {
+        TickType_t wait_start = xTaskGetTickCount();
+        TickType_t ticks = pdMS_TO_TICKS(timeout_ms);
+        TickType_t elapsed;
+        
+        /* Published before done is read, completion reads it after setting done */
+        msg->waiter = xTaskGetCurrentTaskHandle();
+        while (msg->done == 0U) {
+            elapsed = xTaskGetTickCount() - wait_start;
+            if (elapsed >= ticks) {
+                break;
+            }
+            /* A stale notification only causes another pass */
+            (void)ulTaskNotifyTake(pdTRUE, ticks - elapsed);
+        }
+        
+        level = __get_PRIMASK();
+        __disable_irq();
+        msg->waiter = NULL;
+        __set_PRIMASK(level);
+    } else
+#endif
+    {
+        tick_start = HAL_GetTick();
+        while (msg->done == 0U) {
+            if ((HAL_GetTick() - tick_start) >= timeout_ms) {
+                break;
+            }
+            /* WFI with interrupts masked still wakes on a pending IRQ, so a
+               completion between the check and the sleep is not missed */
+            level = __get_PRIMASK();
+            __disable_irq();
+            if (msg->done == 0U) {
+                __WFI();
+            }
+            __set_PRIMASK(level);
+        }
+    }
+    
+    if (msg->done == 0U) {
+        for (i = 0U; i < sizeof(stm32_spi_hw) / sizeof(stm32_spi_hw[0]); i++) {
+            stm32_spi_async_watchdog(&stm32_spi_hw[i]);
+        }
+        if (msg->done == 0U) {
+            return -EAGAIN;
+        }
+    }
+    
+    return msg->status;
+}
+
+/**
+ * @brief Run a controller as SPI slave
+ * @param bus Controller name
+ * @param cfg Slave configuration
+ * @return 0 on success, error code on failure
+ */
+int bsp_spi_slave_start(const char *bus, const struct bsp_spi_slave_cfg *cfg)
+{
+    struct stm32_spi_hw *hw;
+    struct stm32_spi_slave *sl;
+    struct stm32_spi_slave tmp;
+    SPI_TypeDef *spi;
+    DMA_TypeDef *dma;
+    uint32_t level;
+    int ret;
+    
+    hw = stm32_spi_find(bus);
+    if (hw == NULL) {
+        return -ENODEV;
+    }
+    
+    if ((cfg == NULL) || (cfg->ring == NULL) || (cfg->ring_size < 2U) ||
+        (cfg->ring_size > 0xFFFFU)) {
+        return -EINVAL;
+    }
+    
+    /* DMA carries the data, the CPU only sees frame boundaries */
+    if (hw->dma == NULL) {
+        return -ENODEV;
+    }
+    
+    /* Claim the controller against the master paths and a second start */
+    level = __get_PRIMASK();
+    __disable_irq();
+    if ((hw->async_cur != NULL) || (hw->async_busy != 0U) || (hw->sync_busy != 0U) ||
+        (hw->slave.active != 0U)) {
+        __set_PRIMASK(level);
+        return -EBUSY;
+    }
+    hw->slave.active = 1U;
+    __set_PRIMASK(level);
+    
+    sl  = &hw->slave;
+    spi = hw->instance;
+    dma = hw->dma;
+    
+    /* Built aside, active stays set while the state is replaced */
+    memset(&tmp, 0, sizeof(tmp));
+    tmp.active    = 1U;
+    tmp.nss_pin   = cfg->nss_pin;
+    tmp.ring      = cfg->ring;
+    tmp.ring_size = (uint16_t)cfg->ring_size;
+    tmp.frame_cb  = cfg->frame_cb;
+    tmp.arg       = cfg->arg;
+    tmp.cr1 = (uint16_t)(LL_SPI_FULL_DUPLEX | LL_SPI_MODE_SLAVE | LL_SPI_DATAWIDTH_8BIT |
+                         (((cfg->mode & SPI_CPOL) != 0U) ? LL_SPI_POLARITY_HIGH : LL_SPI_POLARITY_LOW) |
+                         (((cfg->mode & SPI_CPHA) != 0U) ? LL_SPI_PHASE_2EDGE : LL_SPI_PHASE_1EDGE) |
+                         (((cfg->mode & SPI_MODE_MSB) != 0U) ? LL_SPI_MSB_FIRST : LL_SPI_LSB_FIRST) |
+                         (LL_SPI_NSS_HARD_INPUT & 0xFFFFU));
+    *sl = tmp;
+    
+    ret = gpio_attach_irq(sl->nss_pin, PIN_EVENT_RISING_EDGE, stm32_spi_slave_nss_isr, hw);
+    if (ret != 0) {
+        sl->active = 0U;
+        return -EIO;
+    }
+    
+    stm32_spi_gpio_slave(spi);
+    
+    /* RX ring: circular, never stopped while the slave runs */
+    LL_DMA_DisableChannel(dma, hw->dma_rx_ch);
+    LL_DMA_DisableIT_TC(dma, hw->dma_rx_ch);
+    LL_DMA_DisableIT_TE(dma, hw->dma_rx_ch);
+    LL_DMA_ConfigTransfer(dma, hw->dma_rx_ch,
+                          LL_DMA_DIRECTION_PERIPH_TO_MEMORY | LL_DMA_MODE_CIRCULAR |
+                          LL_DMA_PERIPH_NOINCREMENT | LL_DMA_MEMORY_INCREMENT |
+                          LL_DMA_PDATAALIGN_BYTE | LL_DMA_MDATAALIGN_BYTE | LL_DMA_PRIORITY_VERYHIGH);
+    LL_DMA_ConfigAddresses(dma, hw->dma_rx_ch, LL_SPI_DMA_GetRegAddr(spi), (uint32_t)sl->ring,
+                           LL_DMA_DIRECTION_PERIPH_TO_MEMORY);
+    LL_DMA_SetDataLength(dma, hw->dma_rx_ch, sl->ring_size);
+    dma->IFCR = STM32_DMA_FLAG(hw->dma_rx_ch, DMA_IFCR_CGIF1);
+    LL_DMA_EnableChannel(dma, hw->dma_rx_ch);
+    
+    stm32_spi_slave_arm(hw);
+    
+    ret = gpio_irq_enable(sl->nss_pin, 1U);
+    if (ret != 0) {
+        (void)bsp_spi_slave_stop(bus);
+        return -EIO;
+    }
+    
+    return 0;
+}
+
+/**
+ * @brief Arm the response clocked out during the next frame
+ * @param bus Controller name
+ * @param buf Response, must stay valid until that frame ends
+ * @param len Response length
+ * @return 0 on success, error code on failure
+ */
+int bsp_spi_slave_set_tx(const char *bus, const void *buf, size_t len)
+{
+    struct stm32_spi_hw *hw;
+    uint32_t level;
+    
+    hw = stm32_spi_find(bus);
+    if (hw == NULL) {
+        return -ENODEV;
+    }
+    
+    if ((buf == NULL) || (len == 0U) || (len > 0xFFFFU)) {
+        return -EINVAL;
+    }
+    
+    if (hw->slave.active == 0U) {
+        return -EINVAL;
+    }
+    
+    level = __get_PRIMASK();
+    __disable_irq();
+    if (hw->slave.tx_next != NULL) {
+        hw->slave.stats.tx_replaced++;
+    }
+    hw->slave.tx_next     = (const uint8_t *)buf;
+    hw->slave.tx_next_len = (uint16_t)len;
+    __set_PRIMASK(level);
+    
+    return 0;
+}
+
+/**
+ * @brief Read the slave counters
+ * @param bus Controller name
+ * @param stats Output
+ * @return 0 on success, error code on failure
+ */
+int bsp_spi_slave_get_stats(const char *bus, struct bsp_spi_slave_stats *stats)
+{
+    struct stm32_spi_hw *hw;
+    uint32_t level;
+    
+    hw = stm32_spi_find(bus);
+    if ((hw == NULL) || (stats == NULL)) {
+        return (hw == NULL) ? -ENODEV : -EINVAL;
+    }
+    
+    level = __get_PRIMASK();
+    __disable_irq();
+    *stats = hw->slave.stats;
+    __set_PRIMASK(level);
+    
+    return 0;
+}
+
+/**
+ * @brief Return a controller to master mode
+ * @param bus Controller name
+ * @return 0 on success, error code on failure
+ */
+int bsp_spi_slave_stop(const char *bus)
+{
+    struct stm32_spi_hw *hw;
+    
+    hw = stm32_spi_find(bus);
+    if (hw == NULL) {
+        return -ENODEV;
+    }
+    
+    if (hw->slave.active == 0U) {
+        return 0;
+    }
+    
+    (void)gpio_irq_enable(hw->slave.nss_pin, 0U);
+    (void)gpio_detach_irq(hw->slave.nss_pin);
+    
+    hw->slave.active = 0U;
+    LL_DMA_DisableChannel(hw->dma, hw->dma_tx_ch);
+    LL_DMA_DisableChannel(hw->dma, hw->dma_rx_ch);
+    hw->dma->IFCR = STM32_DMA_FLAG(hw->dma_rx_ch, DMA_IFCR_CGIF1) |
+                    STM32_DMA_FLAG(hw->dma_tx_ch, DMA_IFCR_CGIF1);
+    
+    /* Reset leaves CR1 at 0, so the next device setup reprograms everything */
+    stm32_spi_periph_reset(hw->instance);
+    
+    return stm32_spi_gpio_init(hw->instance);
+}
+
+/**
+ * @brief Initialize STM32 SPI BSP driver
+ * @return 0 on success, error code on failure
+ */
+int bsp_spi_init(void)
+{
+    int ret;
+    uint8_t i;
+    uint32_t max_speed_hz;
+    size_t spi_count;
+    
+    spi_count = sizeof(stm32_spi_hw) / sizeof(stm32_spi_hw[0]);
+    
+    /* Transfer deadlines run on the DWT cycle counter */
+    BSP_DWT_Init();
+    
+    for (i = 0U; i < spi_count; i++) {
+        /* Get peripheral clock frequency and speed limit */
+        ret = stm32_spi_update_clock(&stm32_spi_hw[i]);
+        if (ret != 0) {
+            LOG_E("Failed to get PCLK frequency for SPI%u", i + 1U);
+            return ret;
+        }
+        
+        max_speed_hz = stm32_spi_hw[i].max_speed_hz;
+        
+        /* Initialize GPIO */
+        ret = stm32_spi_gpio_init(stm32_spi_hw[i].instance);
+        if (ret != 0) {
+            LOG_E("Failed to initialize GPIO for SPI%u", i + 1U);
+            return ret;
+        }
+        
+        /* DMA controller clock */
+        if (stm32_spi_hw[i].dma != NULL) {
+#if defined(DMA2)
+            if (stm32_spi_hw[i].dma == DMA2) {
+                LL_AHB1_GRP1_EnableClock(LL_AHB1_GRP1_PERIPH_DMA2);
+            } else
+#endif
+            {
+                LL_AHB1_GRP1_EnableClock(LL_AHB1_GRP1_PERIPH_DMA1);
+            }
+            HAL_NVIC_SetPriority(stm32_spi_hw[i].dma_irq, BSP_SPI_DMA_IRQ_PRIORITY, 0);
+            HAL_NVIC_EnableIRQ(stm32_spi_hw[i].dma_irq);
+        }
+        
+        stm32_spi_hw[i].ctrl = &stm32_spi_controller[i];
+        
+        /* Register controller */
+        ret = spi_controller_register(&stm32_spi_controller[i], 
+                                     stm32_spi_hw[i].name, 
+                                     &stm32_spi_ops);
+        if (ret != 0) {
+            LOG_E("Failed to register SPI controller '%s'", stm32_spi_hw[i].name);
             return ret;
         }
         
@@ -604,4 +2316,34 @@ int bsp_spi_init(void)
     return 0;
 }
 
+#ifdef BSP_SPI1_USING_DMA
+/**
+ * @brief SPI1 RX DMA interrupt handler
+ */
+void DMA1_Channel2_IRQHandler(void)
+{
+    stm32_spi_dma_irq(&stm32_spi_hw[SPI1_INDEX]);
+}
+#endif
+
+#ifdef BSP_SPI2_USING_DMA
+/**
+ * @brief SPI2 RX DMA interrupt handler
+ */
+void DMA1_Channel4_IRQHandler(void)
+{
+    stm32_spi_dma_irq(&stm32_spi_hw[SPI2_INDEX]);
+}
+#endif
+
+#ifdef BSP_SPI3_USING_DMA
+/**
+ * @brief SPI3 RX DMA interrupt handler
+ */
+void DMA2_Channel1_IRQHandler(void)
+{
+    stm32_spi_dma_irq(&stm32_spi_hw[SPI3_INDEX]);
+}
+#endif
+
 #endif
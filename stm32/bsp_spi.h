@@ -25,8 +25,96 @@
 
 /* Exported types ------------------------------------------------------------*/
 
+/**
+ * @brief One transfer of an asynchronous message
+ */
+struct bsp_spi_xfer {
+    const void *tx_buf;              /**< TX data, NULL to send zeros */
+    void *rx_buf;                    /**< RX buffer, NULL to discard */
+    size_t len;                      /**< Length in bytes */
+    uint8_t cs_change;               /**< Not last: pulse CS inactive before the next
+                                          transfer. Last: leave CS active until the bus
+                                          selects another device */
+};
+
+struct bsp_spi_msg;
+
+/**
+ * @brief Slave frame callback, called from the NSS interrupt
+ * @param data Frame start inside the RX ring
+ * @param len Bytes at data
+ * @param wrap Rest of the frame at the ring start, NULL if it did not wrap
+ * @param wrap_len Bytes at wrap
+ * @param arg Callback argument
+ * @note The data stays valid until the ring wraps around onto it again.
+ */
+typedef void (*bsp_spi_slave_frame_t)(const uint8_t *data, size_t len,
+                                      const uint8_t *wrap, size_t wrap_len, void *arg);
+
+/**
+ * @brief Slave mode configuration
+ */
+struct bsp_spi_slave_cfg {
+    uint32_t mode;                   /**< SPI_CPOL / SPI_CPHA / SPI_MODE_MSB, 8-bit frames */
+    uint8_t nss_pin;                 /**< Controller's hardware NSS pin (gpio pin id) */
+    uint8_t *ring;                   /**< RX ring buffer */
+    size_t ring_size;                /**< RX ring size, 2..65535, at least the longest frame */
+    bsp_spi_slave_frame_t frame_cb;  /**< Frame callback */
+    void *arg;                       /**< Callback argument */
+};
+
+/**
+ * @brief Slave mode counters
+ */
+struct bsp_spi_slave_stats {
+    uint32_t frames;                 /**< Frames delivered */
+    uint32_t rx_bytes;               /**< Bytes delivered */
+    uint32_t rx_overrun;             /**< Frames that hit OVR (DMA did not keep up) */
+    uint32_t rx_overflow;            /**< Frames longer than the ring, dropped */
+    uint32_t tx_underrun;            /**< Frames longer than the armed response */
+    uint32_t tx_replaced;            /**< Armed responses replaced before being sent */
+};
+
+/**
+ * @brief Message completion callback
+ * @note Called from the DMA interrupt, or from the submitting or waiting
+ *       task when the controller has no DMA or a stalled transfer is
+ *       failed by the watchdog, so it must be safe in both. done is
+ *       already set and the next message may be running, so the callback
+ *       can resubmit msg. It must not touch msg when another task waits on
+ *       it and may have reused it.
+ */
+typedef void (*bsp_spi_complete_t)(struct bsp_spi_msg *msg, void *arg);
+
+/**
+ * @brief Asynchronous SPI message
+ * @note The message, its transfer array and buffers belong to the driver
+ *       from bsp_spi_async_submit() until completion (or a successful
+ *       cancel).
+ */
+struct bsp_spi_msg {
+    struct spi_device *dev;          /**< Target device */
+    struct bsp_spi_xfer *xfers;      /**< Transfer array */
+    uint32_t num;                    /**< Number of transfers */
+    bsp_spi_complete_t complete;     /**< Completion callback, may be NULL */
+    void *arg;                       /**< Callback argument */
+    
+    /* Filled in by the driver */
+    int status;                      /**< 0 on success, error code on failure */
+    size_t actual_len;               /**< Bytes transferred */
+    volatile uint8_t done;           /**< Set once status is final */
+    uint32_t idx;                    /**< Transfer in progress */
+    void *volatile waiter;           /**< Task sleeping in bsp_spi_async_wait() */
+    struct bsp_spi_msg *next;        /**< Queue link */
+};
+
 /* Exported constants --------------------------------------------------------*/
 
+/* Returned when a hardware CRC check fails (see bsp_spi_set_crc) */
+#ifndef EBADMSG
+    #define EBADMSG     74
+#endif
+
 /* Exported macros -----------------------------------------------------------*/
 
 /* Exported variables --------------------------------------------------------*/
@@ -39,6 +127,110 @@
  */
 int bsp_spi_init(void);
 
+/**
+ * @brief Re-derive SPI timings after a bus clock change
+ * @return 0 on success, error code on failure
+ * @note Call after SystemCoreClock and the APB prescalers changed. Every
+ *       cached device divider is recomputed; an idle controller is moved
+ *       to the new divider immediately, a busy one at its next setup.
+ */
+int bsp_spi_clock_changed(void);
+
+/**
+ * @brief Report the SCK rate a device gets
+ * @param bus Controller name ("spi1", ...)
+ * @param dev Device
+ * @param requested_hz Output, dev->max_speed_hz clamped to the controller limit
+ * @param actual_hz Output, rate of the selected divider (at most the requested
+ *                  rate, unless that is below PCLK/256)
+ * @return 0 on success, error code on failure
+ */
+int bsp_spi_get_speed(const char *bus, const struct spi_device *dev,
+                      uint32_t *requested_hz, uint32_t *actual_hz);
+
+/**
+ * @brief Enable or disable hardware CRC for a device
+ * @param bus Controller name ("spi1", ...)
+ * @param dev Device
+ * @param poly CRC polynomial (CRC8 for 8-bit frames, CRC16 for 16-bit),
+ *             0 to disable
+ * @return 0 on success, -ENOSPC when BSP_SPI_CRC_DEVICES are in use,
+ *         error code on failure
+ * @note Applies from the next setup of the device. Every transfer then
+ *       sends the CRC after its data and checks the CRC frame received
+ *       after it; a mismatch fails the transfer with -EBADMSG. Received
+ *       CRC frames are not stored in rx_buf.
+ */
+int bsp_spi_set_crc(const char *bus, const struct spi_device *dev, uint16_t poly);
+
+/**
+ * @brief Queue a message on a controller
+ * @param bus Controller name ("spi1", ...)
+ * @param msg Message, see struct bsp_spi_msg
+ * @return 0 when queued, error code on failure
+ * @note Messages run in submission order, back to back from the DMA
+ *       interrupt. Controllers built without DMA run the message in the
+ *       calling context before returning. Returns -EBUSY while a
+ *       synchronous transfer is on the bus.
+ */
+int bsp_spi_async_submit(const char *bus, struct bsp_spi_msg *msg);
+
+/**
+ * @brief Remove a message that has not started yet
+ * @param bus Controller name
+ * @param msg Message passed to bsp_spi_async_submit()
+ * @return 0 when removed (its callback will not run), -EBUSY when the
+ *         message is in flight or already done, error code on failure
+ */
+int bsp_spi_async_cancel(const char *bus, struct bsp_spi_msg *msg);
+
+/**
+ * @brief Wait for a message to complete
+ * @param msg Message passed to bsp_spi_async_submit()
+ * @param timeout_ms Maximum wait in milliseconds
+ * @return Message status, -EAGAIN on timeout
+ * @note Under FreeRTOS the calling task sleeps on its notification value.
+ *       A DMA transfer that overran its deadline is aborted when the wait
+ *       times out (or on the next submit) and its message ends with -EIO.
+ */
+int bsp_spi_async_wait(struct bsp_spi_msg *msg, uint32_t timeout_ms);
+
+/**
+ * @brief Run a controller as SPI slave
+ * @param bus Controller name ("spi1", ...), must be built with DMA
+ * @param cfg Slave configuration
+ * @return 0 on success, error code on failure
+ * @note The hardware NSS input frames reception; an EXTI on its rising
+ *       edge ends the frame. Master-side calls on this controller return
+ *       -EBUSY until bsp_spi_slave_stop().
+ */
+int bsp_spi_slave_start(const char *bus, const struct bsp_spi_slave_cfg *cfg);
+
+/**
+ * @brief Arm the response clocked out during the next frame
+ * @param bus Controller name
+ * @param buf Response, must stay valid until that frame ends
+ * @param len Response length
+ * @return 0 on success, error code on failure
+ * @note One-shot: a frame without an armed response sends zeros.
+ */
+int bsp_spi_slave_set_tx(const char *bus, const void *buf, size_t len);
+
+/**
+ * @brief Read the slave counters
+ * @param bus Controller name
+ * @param stats Output
+ * @return 0 on success, error code on failure
+ */
+int bsp_spi_slave_get_stats(const char *bus, struct bsp_spi_slave_stats *stats);
+
+/**
+ * @brief Return a controller to master mode
+ * @param bus Controller name
+ * @return 0 on success, error code on failure
+ */
+int bsp_spi_slave_stop(const char *bus);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -0,0 +1,531 @@
+/**
+  ******************************************************************************
+  * @file        : bsp_spi_nor.c
+  * @author      : ZJY
+  * @version     : V1.0
+  * @date        : 2025-01-XX
+  * @brief       : SPI NOR flash read engine with RAM page cache
+  * @attention   : All bus traffic goes through bsp_spi_async_submit(), so
+  *                reads use the controller DMA when it has one.
+  ******************************************************************************
+  * @history     :
+  *         V1.0 : 1. Fast read (0x0B) through the async SPI queue
+  *                2. LRU page cache, invalidated on program/erase
+  *
+  ******************************************************************************
+  */
+/* Includes ------------------------------------------------------------------*/
+#include "bsp_spi_nor.h"
+#include "errno-base.h"
+#include "bsp_conf.h"
+#include <string.h>
+
+#define  LOG_TAG             "bsp_spi_nor"
+#define  LOG_LVL             4
+#include "log.h"
+
+#ifdef BSP_USING_SPI_NOR
+
+/* Private define ------------------------------------------------------------*/
+#define SPI_NOR_CMD_WREN                (0x06U)
+#define SPI_NOR_CMD_RDSR                (0x05U)
+#define SPI_NOR_CMD_PP                  (0x02U)
+#define SPI_NOR_CMD_SE                  (0x20U)
+#define SPI_NOR_CMD_FAST_READ           (0x0BU)
+#define SPI_NOR_SR_WIP                  (0x01U)
+
+/* Page program granularity, fixed by the flash whatever the cache line */
+#define SPI_NOR_PAGE_SIZE               (256U)
+
+/* Line lookup and fill align addresses with LINE_SIZE - 1 masks */
+#if ((BSP_SPI_NOR_LINE_SIZE == 0) || ((BSP_SPI_NOR_LINE_SIZE & (BSP_SPI_NOR_LINE_SIZE - 1)) != 0))
+#error "BSP_SPI_NOR_LINE_SIZE must be a power of two"
+#endif
+
+/* Largest single transfer accepted by the DMA path */
+#define SPI_NOR_MAX_XFER                (0xFFFFU)
+
+/* Bus timeout for one message */
+#ifndef BSP_SPI_NOR_XFER_TIMEOUT_MS
+    #define BSP_SPI_NOR_XFER_TIMEOUT_MS (100U)
+#endif
+
+/* Busy timeouts, datasheet maxima of common 4K-sector parts plus margin */
+#ifndef BSP_SPI_NOR_PROGRAM_TIMEOUT_MS
+    #define BSP_SPI_NOR_PROGRAM_TIMEOUT_MS  (10U)
+#endif
+
+#ifndef BSP_SPI_NOR_ERASE_TIMEOUT_MS
+    #define BSP_SPI_NOR_ERASE_TIMEOUT_MS    (500U)
+#endif
+
+/* Reads of at least this size skip the cache */
+#define SPI_NOR_BYPASS_SIZE             (BSP_SPI_NOR_LINE_SIZE * BSP_SPI_NOR_CACHE_LINES)
+
+/* Private function prototypes -----------------------------------------------*/
+static int spi_nor_run(struct bsp_spi_nor *nor, struct bsp_spi_xfer *xfers, uint32_t num);
+static int spi_nor_cmd_addr(struct bsp_spi_nor *nor, uint8_t cmd, uint32_t addr,
+                            const void *tx_buf, size_t len);
+static int spi_nor_write_enable(struct bsp_spi_nor *nor);
+static int spi_nor_wait_ready(struct bsp_spi_nor *nor, uint32_t timeout_ms);
+static int spi_nor_read_direct(struct bsp_spi_nor *nor, uint32_t addr, uint8_t *buf, size_t len);
+static struct bsp_spi_nor_line *spi_nor_lookup(struct bsp_spi_nor *nor, uint32_t page);
+static struct bsp_spi_nor_line *spi_nor_victim(struct bsp_spi_nor *nor);
+static void spi_nor_copy(const struct bsp_spi_nor_line *line, uint32_t addr, uint32_t end,
+                         uint8_t *buf);
+static void spi_nor_fill_cmd(uint8_t *cmd, uint8_t op, uint32_t addr);
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+ * @brief Run one message and wait for it
+ * @param nor Instance
+ * @param xfers Transfer array
+ * @param num Number of transfers
+ * @return 0 on success, error code on failure
+ * @note The message lives on the stack, so once it has started we wait
+ *       for the DMA to finish it even past the timeout.
+ */
+static int spi_nor_run(struct bsp_spi_nor *nor, struct bsp_spi_xfer *xfers, uint32_t num)
+{
+    struct bsp_spi_msg msg;
+    int ret;
+    
+    memset(&msg, 0, sizeof(msg));
+    msg.dev   = nor->dev;
+    msg.xfers = xfers;
+    msg.num   = num;
+    
+    ret = bsp_spi_async_submit(nor->bus, &msg);
+    if (ret != 0) {
+        return ret;
+    }
+    
+    ret = bsp_spi_async_wait(&msg, BSP_SPI_NOR_XFER_TIMEOUT_MS);
+    if (ret == -EAGAIN) {
+        if (bsp_spi_async_cancel(nor->bus, &msg) == 0) {
+            LOG_E("%s: bus busy, read not started", nor->bus);
+            return -EAGAIN;
+        }
+        LOG_W("%s: message overran its timeout", nor->bus);
+        while ((ret = bsp_spi_async_wait(&msg, BSP_SPI_NOR_XFER_TIMEOUT_MS)) == -EAGAIN) {
+            /* Wait */
+        }
+    }
+    
+    return ret;
+}
+
+/**
+ * @brief Fill an opcode and 24-bit address
+ * @param cmd Destination, 4 bytes
+ * @param op Opcode
+ * @param addr Flash address
+ */
+static void spi_nor_fill_cmd(uint8_t *cmd, uint8_t op, uint32_t addr)
+{
+    cmd[0] = op;
+    cmd[1] = (uint8_t)(addr >> 16);
+    cmd[2] = (uint8_t)(addr >> 8);
+    cmd[3] = (uint8_t)addr;
+}
+
+/**
+ * @brief Send an opcode with address and optional TX payload
+ * @param nor Instance
+ * @param cmd Opcode
+ * @param addr Flash address
+ * @param tx_buf Payload, NULL for none
+ * @param len Payload length
+ * @return 0 on success, error code on failure
+ */
+static int spi_nor_cmd_addr(struct bsp_spi_nor *nor, uint8_t cmd, uint32_t addr,
+                            const void *tx_buf, size_t len)
+{
+    uint8_t hdr[4];
+    struct bsp_spi_xfer xfers[2];
+    
+    spi_nor_fill_cmd(hdr, cmd, addr);
+    
+    memset(xfers, 0, sizeof(xfers));
+    xfers[0].tx_buf = hdr;
+    xfers[0].len    = sizeof(hdr);
+    xfers[1].tx_buf = tx_buf;
+    xfers[1].len    = len;
+    
+    return spi_nor_run(nor, xfers, (tx_buf != NULL) ? 2U : 1U);
+}
+
+/**
+ * @brief Set the write enable latch
+ * @param nor Instance
+ * @return 0 on success, error code on failure
+ */
+static int spi_nor_write_enable(struct bsp_spi_nor *nor)
+{
+    static const uint8_t cmd = SPI_NOR_CMD_WREN;
+    struct bsp_spi_xfer xfer;
+    
+    memset(&xfer, 0, sizeof(xfer));
+    xfer.tx_buf = &cmd;
+    xfer.len    = 1U;
+    
+    return spi_nor_run(nor, &xfer, 1U);
+}
+
+/**
+ * @brief Poll the status register until the flash is idle
+ * @param nor Instance
+ * @param timeout_ms Maximum wait in milliseconds
+ * @return 0 on success, error code on failure
+ */
+static int spi_nor_wait_ready(struct bsp_spi_nor *nor, uint32_t timeout_ms)
+{
+    static const uint8_t cmd = SPI_NOR_CMD_RDSR;
+    struct bsp_spi_xfer xfers[2];
+    uint8_t status;
+    uint32_t tick_start;
+    int ret;
+    
+    memset(xfers, 0, sizeof(xfers));
+    xfers[0].tx_buf = &cmd;
+    xfers[0].len    = 1U;
+    xfers[1].rx_buf = &status;
+    xfers[1].len    = 1U;
+    
+    tick_start = HAL_GetTick();
+    for (;;) {
+        ret = spi_nor_run(nor, xfers, 2U);
+        if (ret != 0) {
+            return ret;
+        }
+        if ((status & SPI_NOR_SR_WIP) == 0U) {
+            return 0;
+        }
+        if ((HAL_GetTick() - tick_start) > timeout_ms) {
+            LOG_E("%s: flash busy timeout", nor->bus);
+            return -EIO;
+        }
+    }
+}
+
+/**
+ * @brief Fast read straight into the caller's buffer
+ * @param nor Instance
+ * @param addr Flash address
+ * @param buf Destination
+ * @param len Number of bytes
+ * @return 0 on success, error code on failure
+ */
+static int spi_nor_read_direct(struct bsp_spi_nor *nor, uint32_t addr, uint8_t *buf, size_t len)
+{
+    uint8_t hdr[5];
+    struct bsp_spi_xfer xfers[2];
+    size_t chunk;
+    int ret;
+    
+    while (len > 0U) {
+        chunk = (len > SPI_NOR_MAX_XFER) ? SPI_NOR_MAX_XFER : len;
+        
+        spi_nor_fill_cmd(hdr, SPI_NOR_CMD_FAST_READ, addr);
+        hdr[4] = 0x00U;  /* Dummy byte */
+        
+        memset(xfers, 0, sizeof(xfers));
+        xfers[0].tx_buf = hdr;
+        xfers[0].len    = sizeof(hdr);
+        xfers[1].rx_buf = buf;
+        xfers[1].len    = chunk;
+        
+        ret = spi_nor_run(nor, xfers, 2U);
+        if (ret != 0) {
+            return ret;
+        }
+        nor->commands++;
+        
+        addr += (uint32_t)chunk;
+        buf  += chunk;
+        len  -= chunk;
+    }
+    
+    return 0;
+}
+
+/**
+ * @brief Find a cached page
+ * @param nor Instance
+ * @param page Page address
+ * @return Line, NULL on miss
+ */
+static struct bsp_spi_nor_line *spi_nor_lookup(struct bsp_spi_nor *nor, uint32_t page)
+{
+    uint32_t i;
+    
+    for (i = 0U; i < BSP_SPI_NOR_CACHE_LINES; i++) {
+        if ((nor->lines[i].valid != 0U) && (nor->lines[i].addr == page)) {
+            return &nor->lines[i];
+        }
+    }
+    
+    return NULL;
+}
+
+/**
+ * @brief Pick the line to replace
+ * @param nor Instance
+ * @return Least recently used line, free lines first
+ * @note The line is stamped as most recent so a batch never picks it twice.
+ */
+static struct bsp_spi_nor_line *spi_nor_victim(struct bsp_spi_nor *nor)
+{
+    struct bsp_spi_nor_line *victim = &nor->lines[0];
+    uint32_t i;
+    
+    for (i = 0U; i < BSP_SPI_NOR_CACHE_LINES; i++) {
+        if (nor->lines[i].valid == 0U) {
+            if ((victim->valid != 0U) || (nor->lines[i].stamp < victim->stamp)) {
+                victim = &nor->lines[i];
+            }
+        } else if ((victim->valid != 0U) && (nor->lines[i].stamp < victim->stamp)) {
+            victim = &nor->lines[i];
+        }
+    }
+    
+    victim->valid = 0U;
+    victim->stamp = ++nor->clock;
+    
+    return victim;
+}
+
+/**
+ * @brief Copy the part of a cached page that falls inside a request
+ * @param line Cached page
+ * @param addr Request start address
+ * @param end Request end address (exclusive)
+ * @param buf Request buffer
+ */
+static void spi_nor_copy(const struct bsp_spi_nor_line *line, uint32_t addr, uint32_t end,
+                         uint8_t *buf)
+{
+    uint32_t from = (line->addr > addr) ? line->addr : addr;
+    uint32_t to   = line->addr + BSP_SPI_NOR_LINE_SIZE;
+    
+    if (to > end) {
+        to = end;
+    }
+    
+    memcpy(&buf[from - addr], &line->data[from - line->addr], to - from);
+}
+
+/* Exported functions --------------------------------------------------------*/
+
+/**
+ * @brief Initialize a SPI NOR instance
+ * @param nor Instance
+ * @param bus Controller name
+ * @param dev Flash device
+ * @return 0 on success, error code on failure
+ */
+int bsp_spi_nor_init(struct bsp_spi_nor *nor, const char *bus, struct spi_device *dev)
+{
+    if ((nor == NULL) || (bus == NULL) || (dev == NULL)) {
+        return -EINVAL;
+    }
+    
+    memset(nor, 0, sizeof(*nor));
+    nor->bus = bus;
+    nor->dev = dev;
+    
+    return 0;
+}
+
+/**
+ * @brief Read from the flash
+ * @param nor Instance
+ * @param addr Flash address
+ * @param buf Destination
+ * @param len Number of bytes
+ * @return 0 on success, error code on failure
+ */
+int bsp_spi_nor_read(struct bsp_spi_nor *nor, uint32_t addr, void *buf, size_t len)
+{
+    struct bsp_spi_xfer xfers[BSP_SPI_NOR_CACHE_LINES + 1U];
+    struct bsp_spi_nor_line *fill[BSP_SPI_NOR_CACHE_LINES];
+    struct bsp_spi_nor_line *line;
+    uint8_t hdr[5];
+    uint8_t *dst = (uint8_t *)buf;
+    uint32_t end;
+    uint32_t page;
+    uint32_t n;
+    uint32_t i;
+    int ret;
+    
+    if ((nor == NULL) || ((buf == NULL) && (len != 0U))) {
+        return -EINVAL;
+    }
+    
+    if (len == 0U) {
+        return 0;
+    }
+    
+    if (len >= SPI_NOR_BYPASS_SIZE) {
+        return spi_nor_read_direct(nor, addr, dst, len);
+    }
+    
+    end  = addr + (uint32_t)len;
+    page = addr & ~(BSP_SPI_NOR_LINE_SIZE - 1U);
+    
+    while (page < end) {
+        line = spi_nor_lookup(nor, page);
+        if (line != NULL) {
+            line->stamp = ++nor->clock;
+            spi_nor_copy(line, addr, end, dst);
+            nor->hits++;
+            page += BSP_SPI_NOR_LINE_SIZE;
+            continue;
+        }
+        
+        /* Collect the run of missing pages and fetch it with one command */
+        n = 0U;
+        do {
+            fill[n] = spi_nor_victim(nor);
+            fill[n]->addr = page + n * BSP_SPI_NOR_LINE_SIZE;
+            n++;
+        } while ((n < BSP_SPI_NOR_CACHE_LINES) &&
+                 ((page + n * BSP_SPI_NOR_LINE_SIZE) < end) &&
+                 (spi_nor_lookup(nor, page + n * BSP_SPI_NOR_LINE_SIZE) == NULL));
+        
+        spi_nor_fill_cmd(hdr, SPI_NOR_CMD_FAST_READ, page);
+        hdr[4] = 0x00U;  /* Dummy byte */
+        
+        memset(xfers, 0, sizeof(xfers));
+        xfers[0].tx_buf = hdr;
+        xfers[0].len    = sizeof(hdr);
+        for (i = 0U; i < n; i++) {
+            xfers[i + 1U].rx_buf = fill[i]->data;
+            xfers[i + 1U].len    = BSP_SPI_NOR_LINE_SIZE;
+        }
+        
+        ret = spi_nor_run(nor, xfers, n + 1U);
+        if (ret != 0) {
+            return ret;
+        }
+        nor->commands++;
+        nor->misses += n;
+        
+        for (i = 0U; i < n; i++) {
+            fill[i]->valid = 1U;
+            spi_nor_copy(fill[i], addr, end, dst);
+        }
+        page += n * BSP_SPI_NOR_LINE_SIZE;
+    }
+    
+    return 0;
+}
+
+/**
+ * @brief Program the flash
+ * @param nor Instance
+ * @param addr Flash address
+ * @param buf Source
+ * @param len Number of bytes
+ * @return 0 on success, error code on failure
+ */
+int bsp_spi_nor_program(struct bsp_spi_nor *nor, uint32_t addr, const void *buf, size_t len)
+{
+    const uint8_t *src = (const uint8_t *)buf;
+    size_t chunk;
+    int ret;
+    
+    if ((nor == NULL) || ((buf == NULL) && (len != 0U))) {
+        return -EINVAL;
+    }
+    
+    bsp_spi_nor_invalidate(nor, addr, len);
+    
+    while (len > 0U) {
+        /* Page program wraps inside the page, never cross it */
+        chunk = SPI_NOR_PAGE_SIZE - (addr & (SPI_NOR_PAGE_SIZE - 1U));
+        if (chunk > len) {
+            chunk = len;
+        }
+        
+        ret = spi_nor_write_enable(nor);
+        if (ret == 0) {
+            ret = spi_nor_cmd_addr(nor, SPI_NOR_CMD_PP, addr, src, chunk);
+        }
+        if (ret == 0) {
+            ret = spi_nor_wait_ready(nor, BSP_SPI_NOR_PROGRAM_TIMEOUT_MS);
+        }
+        if (ret != 0) {
+            return ret;
+        }
+        
+        addr += (uint32_t)chunk;
+        src  += chunk;
+        len  -= chunk;
+    }
+    
+    return 0;
+}
+
+/**
+ * @brief Erase the sectors covering a range
+ * @param nor Instance
+ * @param addr Flash address, sector aligned
+ * @param len Number of bytes, multiple of the sector size
+ * @return 0 on success, error code on failure
+ */
+int bsp_spi_nor_erase(struct bsp_spi_nor *nor, uint32_t addr, size_t len)
+{
+    int ret;
+    
+    if ((nor == NULL) || ((addr & (BSP_SPI_NOR_SECTOR_SIZE - 1U)) != 0U) ||
+        ((len & (BSP_SPI_NOR_SECTOR_SIZE - 1U)) != 0U)) {
+        return -EINVAL;
+    }
+    
+    bsp_spi_nor_invalidate(nor, addr, len);
+    
+    while (len > 0U) {
+        ret = spi_nor_write_enable(nor);
+        if (ret == 0) {
+            ret = spi_nor_cmd_addr(nor, SPI_NOR_CMD_SE, addr, NULL, 0U);
+        }
+        if (ret == 0) {
+            ret = spi_nor_wait_ready(nor, BSP_SPI_NOR_ERASE_TIMEOUT_MS);
+        }
+        if (ret != 0) {
+            return ret;
+        }
+        
+        addr += BSP_SPI_NOR_SECTOR_SIZE;
+        len  -= BSP_SPI_NOR_SECTOR_SIZE;
+    }
+    
+    return 0;
+}
+
+/**
+ * @brief Drop cached pages overlapping a range
+ * @param nor Instance
+ * @param addr Flash address
+ * @param len Number of bytes
+ */
+void bsp_spi_nor_invalidate(struct bsp_spi_nor *nor, uint32_t addr, size_t len)
+{
+    uint32_t i;
+    uint32_t end = addr + (uint32_t)len;
+    
+    if ((nor == NULL) || (len == 0U)) {
+        return;
+    }
+    
+    for (i = 0U; i < BSP_SPI_NOR_CACHE_LINES; i++) {
+        if ((nor->lines[i].addr < end) &&
+            ((nor->lines[i].addr + BSP_SPI_NOR_LINE_SIZE) > addr)) {
+            nor->lines[i].valid = 0U;
+        }
+    }
+}
+
+#endif /* BSP_USING_SPI_NOR */
@@ -0,0 +1,122 @@
+/**
+  ******************************************************************************
+  * @file        : bsp_spi_nor.h
+  * @author      : ZJY
+  * @version     : V1.0
+  * @date        : 2025-01-XX
+  * @brief       : SPI NOR flash read engine with RAM page cache
+  * @attention   : None
+  ******************************************************************************
+  * @history     :
+  *         V1.0 : 1. Fast read (0x0B) through the async SPI queue
+  *                2. LRU page cache, invalidated on program/erase
+  *
+  ******************************************************************************
+  */
+#ifndef __BSP_SPI_NOR_H__
+#define __BSP_SPI_NOR_H__
+
+#ifdef __cplusplus
+ extern "C" {
+#endif /* __cplusplus */
+
+/* Includes ------------------------------------------------------------------*/
+#include "bsp_spi.h"
+
+/* Exported constants --------------------------------------------------------*/
+
+/* Cache line size in bytes, a power of two (one flash page by default) */
+#ifndef BSP_SPI_NOR_LINE_SIZE
+    #define BSP_SPI_NOR_LINE_SIZE       (256U)
+#endif
+
+/* Number of cache lines */
+#ifndef BSP_SPI_NOR_CACHE_LINES
+    #define BSP_SPI_NOR_CACHE_LINES     (8U)
+#endif
+
+/* Erase granularity (sector erase 0x20) */
+#define BSP_SPI_NOR_SECTOR_SIZE         (4096U)
+
+/* Exported types ------------------------------------------------------------*/
+
+/**
+ * @brief One cached flash page
+ */
+struct bsp_spi_nor_line {
+    uint32_t addr;                   /**< Page address, line size aligned */
+    uint32_t stamp;                  /**< Last use, for LRU replacement */
+    uint8_t valid;                   /**< Line holds data */
+    uint8_t data[BSP_SPI_NOR_LINE_SIZE]; /**< Page content */
+};
+
+/**
+ * @brief SPI NOR instance
+ */
+struct bsp_spi_nor {
+    const char *bus;                 /**< Controller name */
+    struct spi_device *dev;          /**< Flash device (8-bit frames, mode 0 or 3) */
+    uint32_t clock;                  /**< LRU clock */
+    uint32_t hits;                   /**< Lines served from the cache */
+    uint32_t misses;                 /**< Lines fetched from the flash */
+    uint32_t commands;               /**< Read commands issued */
+    struct bsp_spi_nor_line lines[BSP_SPI_NOR_CACHE_LINES]; /**< Cache */
+};
+
+/* Exported functions --------------------------------------------------------*/
+
+/**
+ * @brief Initialize a SPI NOR instance
+ * @param nor Instance
+ * @param bus Controller name ("spi1", ...)
+ * @param dev Flash device
+ * @return 0 on success, error code on failure
+ */
+int bsp_spi_nor_init(struct bsp_spi_nor *nor, const char *bus, struct spi_device *dev);
+
+/**
+ * @brief Read from the flash
+ * @param nor Instance
+ * @param addr Flash address
+ * @param buf Destination
+ * @param len Number of bytes
+ * @return 0 on success, error code on failure
+ * @note Small reads go through the page cache, and adjacent missing pages
+ *       are fetched with a single fast read command. Reads of at least
+ *       the cache size bypass the cache.
+ */
+int bsp_spi_nor_read(struct bsp_spi_nor *nor, uint32_t addr, void *buf, size_t len);
+
+/**
+ * @brief Program the flash (page program 0x02)
+ * @param nor Instance
+ * @param addr Flash address
+ * @param buf Source
+ * @param len Number of bytes, split on page boundaries
+ * @return 0 on success, error code on failure
+ */
+int bsp_spi_nor_program(struct bsp_spi_nor *nor, uint32_t addr, const void *buf, size_t len);
+
+/**
+ * @brief Erase the sectors covering a range (sector erase 0x20)
+ * @param nor Instance
+ * @param addr Flash address, sector aligned
+ * @param len Number of bytes, multiple of the sector size
+ * @return 0 on success, error code on failure
+ */
+int bsp_spi_nor_erase(struct bsp_spi_nor *nor, uint32_t addr, size_t len);
+
+/**
+ * @brief Drop cached pages overlapping a range
+ * @param nor Instance
+ * @param addr Flash address
+ * @param len Number of bytes
+ * @note For writers that bypass this driver.
+ */
+void bsp_spi_nor_invalidate(struct bsp_spi_nor *nor, uint32_t addr, size_t len);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __BSP_SPI_NOR_H__ */
@@ -18,7 +18,16 @@
 #include "main.h"
 #include "bsp_conf.h"
 #include "dev_uart.h"
+#include "bsp_dwt.h"
+#include "bsp_gpio.h"
 #include "errno-base.h"
+#include <string.h>
+
+/* FreeRTOS support */
+#if defined(USING_FREERTOS) || defined(configUSE_MUTEXES)
+#include "FreeRTOS.h"
+#include "task.h"
+#endif
 
 #define  LOG_TAG             "bsp_uart"
 #define  LOG_LVL             ELOG_LVL_DEBUG
@@ -31,11 +40,69 @@ struct stm32_uart {
     UART_HandleTypeDef *huart;
     uint8_t *rx_cache_buf;
     uint16_t rx_cache_bufsz;
-    uint16_t last_pos;
+    uint16_t last_pos;          ///< Consumer index: bytes before it were already forwarded
+    uint8_t  rx_circular;       ///< RX DMA runs in circular mode, rx_cache_buf is a ring
+    volatile uint8_t tx_state;  ///< STM32_UART_TX_xxx, DMA transmit pipeline state
+    uint8_t  frame_mode;        ///< BSP_UART_FRAME_xxx
+    uint8_t  frame_hdr;         ///< Length header bytes still expected (LEN modes)
+    uint16_t frame_start;       ///< Ring index of the current frame's payload
+    uint16_t frame_len;         ///< Payload bytes of the current frame seen so far
+    uint16_t frame_need;        ///< Payload length announced by the header (LEN modes)
+    BSP_UART_FrameCb_t frame_cb;
+    uint32_t coalesce_us;       ///< RX latency ceiling, 0 = notify on every IDLE
+    uint16_t coalesce_min;      ///< IDLE bursts below this many bytes are coalesced
+    volatile uint8_t idle_masked; ///< IDLE interrupt masked, HT/TC/poll deliver
+    struct stm32_uart *bridge_peer; ///< RX side: TX port received data is forwarded to
+    struct stm32_uart *bridge_src;  ///< TX side: RX port owning this transmitter
+    uint16_t bridge_base;       ///< Ring index where forwarding started
+    uint16_t bridge_inflight;   ///< Bytes in the peer's current TX DMA segment
+    uint32_t bridge_in;         ///< Bytes queued for forwarding since bridge start
+    uint32_t bridge_out;        ///< Bytes handed to the peer TX DMA since bridge start
+    uint8_t  bridge_paused;     ///< RX DMA request held off for back-pressure
+    GPIO_TypeDef *de_port;      ///< RS-485 DE GPIO port, NULL when DE is not software driven
+    uint16_t de_mask;           ///< RS-485 DE GPIO pin mask
+    uint8_t  de_active_high;    ///< RS-485 DE polarity
+    uint32_t tx_done_cycles;    ///< DWT stamp of the last TX DMA completion
+    BSP_UART_Stats_t stats;     ///< Counters read through BSP_UART_GetStats
     Uart_t *port;               ///< Back-pointer to generic uart device, set by BSP_UART_Init
 };
 
 /* Private define ------------------------------------------------------------*/
+/* DMA transmit pipeline state */
+enum
+{
+    STM32_UART_TX_IDLE,         ///< Line idle, HAL gState is READY
+    STM32_UART_TX_DMA,          ///< A segment is being moved by the TX DMA
+    STM32_UART_TX_DRAIN,        ///< DMA done, last bytes still shifting out, next segment may be queued
+};
+
+/* TX data register name differs between STM32 families */
+#if defined(USART_TDR_TDR)
+#define UART_TX_DATA_REG(huart)     (&(huart)->Instance->TDR)
+#else
+#define UART_TX_DATA_REG(huart)     (&(huart)->Instance->DR)
+#endif
+
+/* Frame delimiters */
+#define UART_SLIP_END               (0xC0U)
+#define UART_COBS_DELIM             (0x00U)
+
+/* Approximate line bits per character used for latency budgeting */
+#define UART_BITS_PER_CHAR          (10U)
+
+/* Maximum time STM32_UART_Config waits for the transmitter to drain */
+#ifndef UART_CONFIG_DRAIN_TIMEOUT_MS
+    #define UART_CONFIG_DRAIN_TIMEOUT_MS    (100U)
+#endif
+
+/*
+ * HAL handle to driver context lookup. USART register blocks are 1 KiB
+ * apart, so bits [14:10] of the instance address give a distinct slot per
+ * port on the supported families; collisions are rejected in BSP_UART_Init.
+ */
+#define UART_LUT_SIZE               (32U)
+#define UART_LUT_SLOT(instance)     ((uint8_t)((((uint32_t)(instance)) >> 10U) & (UART_LUT_SIZE - 1U)))
+
 enum
 {
 #ifdef BSP_USING_UART1
@@ -133,6 +200,9 @@ enum
     static uint8_t lpuart1_rx_cache_buf[LPUART1_RX_CACHE_BUF_SIZE] = {0};
 #endif // BSP_USING_LPUART1
 
+/* Instance slot -> stm_uart_drv index + 1, 0 marks an unused slot */
+static uint8_t stm_uart_lut[UART_LUT_SIZE] = {0};
+
 /* 平台专有驱动结构体变量定义 */
 static struct stm32_uart stm_uart_drv[UART_INDEX_MAX] =
 {
@@ -220,6 +290,24 @@ static int32_t STM32_UART_StartReceive(Uart_t *port);
 static int32_t STM32_UART_Config(Uart_t *port, struct uart_configure *cfg);
 static bool    STM32_UART_TxIsBusy(struct uart *port);
 static struct stm32_uart *stm32_uart_from_handle(const UART_HandleTypeDef *huart);
+static bool    stm32_uart_dma_declared(const UART_HandleTypeDef *huart);
+static void    stm32_uart_rx_ring_update(struct stm32_uart *stm_uart, uint16_t pos);
+static void    stm32_uart_rx_flush(struct stm32_uart *stm_uart);
+static void    stm32_uart_rx_deliver(struct stm32_uart *stm_uart, uint16_t off, uint16_t len);
+static void    stm32_uart_frame_scan(struct stm32_uart *stm_uart, uint16_t off, uint16_t len);
+static void    stm32_uart_frame_emit(struct stm32_uart *stm_uart);
+static void    stm32_uart_rx_event(struct stm32_uart *stm_uart, uint16_t Size);
+static void    stm32_uart_coalesce_update(struct stm32_uart *stm_uart);
+static void    stm32_uart_bridge_push(struct stm32_uart *src, uint16_t len);
+static void    stm32_uart_bridge_kick(struct stm32_uart *src);
+static void    stm32_uart_bridge_tx_done(struct stm32_uart *src);
+static void    stm32_uart_bridge_pause(struct stm32_uart *src);
+static void    stm32_uart_bridge_resume(struct stm32_uart *src);
+static void    stm32_uart_de_write(const struct stm32_uart *stm_uart, bool active);
+static int32_t stm32_uart_cfg_to_init(const struct uart_configure *cfg, UART_InitTypeDef *init);
+static int32_t stm32_uart_tx_dma_start(struct stm32_uart *stm_uart, const uint8_t *data, uint16_t size);
+static void    stm32_uart_dma_tx_cplt(DMA_HandleTypeDef *hdma);
+static void    stm32_uart_dma_tx_error(DMA_HandleTypeDef *hdma);
 
 /* Serial operations structure */
 static const Uart_Ops_t stm_uart_ops = {
@@ -244,22 +332,176 @@ static int32_t STM32_UART_Init(Uart_t *port)
 }
 
 /**
-  * @brief  Configure UART parameters (not yet implemented)
+  * @brief  Re-configure baud rate and frame format at runtime
   * @param  port: Pointer to uart device
   * @param  cfg: Pointer to configuration structure
-  * @retval -ERR_NOSYS (runtime re-configuration not implemented)
+  * @note   TX is drained first, the RX DMA is stopped and everything it
+  *         already received is forwarded before BRR/CR1/CR2 are rewritten,
+  *         so no byte received under the old settings is dropped. Flow
+  *         control is left as configured by the MSP. On failure the old
+  *         settings are restored and reception is re-armed.
+  * @retval 0 on success, negative error code on failure
   */
 static int32_t STM32_UART_Config(Uart_t *port, struct uart_configure *cfg)
 {
-    (void)port;
-    (void)cfg;
-    return -ERR_NOSYS;
+    struct stm32_uart *stm_uart;
+    UART_HandleTypeDef *huart;
+    UART_InitTypeDef init;
+    UART_InitTypeDef old_init;
+    uint32_t tick_start;
+    uint32_t cycles_start;
+    int32_t ret;
+
+    if ((port == NULL) || (cfg == NULL)) {
+        return -ERR_INVAL;
+    }
+
+    stm_uart = (struct stm32_uart *)port->prv_data;
+    huart    = stm_uart->huart;
+
+    /* Validate before touching the hardware so a bad cfg changes nothing */
+    init = huart->Init;
+    ret  = stm32_uart_cfg_to_init(cfg, &init);
+    if (ret != 0) {
+        return ret;
+    }
+
+    /* Drain TX: pipeline idle and last stop bit on the wire */
+    tick_start = HAL_GetTick();
+    while ((huart->gState != HAL_UART_STATE_READY) ||
+           (__HAL_UART_GET_FLAG(huart, UART_FLAG_TC) == RESET)) {
+        if ((HAL_GetTick() - tick_start) > UART_CONFIG_DRAIN_TIMEOUT_MS) {
+            log_w("UART TX drain timeout");
+            return -ERR_BUSY;
+        }
+        /* Let other tasks run while the last bytes shift out */
+#if defined(USING_FREERTOS) || defined(configUSE_MUTEXES)
+        if (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING) {
+            vTaskDelay(1);
+            continue;
+        }
+#endif
+        __WFI();
+    }
+
+    cycles_start = BSP_DWT_GetTick();
+
+    /* Quiesce RX, then forward what the DMA produced up to the stop point */
+    if (HAL_UART_AbortReceive(huart) != HAL_OK) {
+        log_e("HAL_UART_AbortReceive failed");
+        (void)STM32_UART_StartReceive(port);
+        return -ERR_IO;
+    }
+    stm32_uart_rx_flush(stm_uart);
+
+    old_init    = huart->Init;
+    huart->Init = init;
+    if (HAL_UART_Init(huart) != HAL_OK) {
+        log_e("HAL_UART_Init failed");
+        /* Keep the port alive with the settings it had */
+        huart->Init = old_init;
+        (void)HAL_UART_Init(huart);
+        (void)STM32_UART_StartReceive(port);
+        return -ERR_IO;
+    }
+
+    ret = STM32_UART_StartReceive(port);
+    stm32_uart_coalesce_update(stm_uart);
+
+    stm_uart->stats.reconf_cycles = BSP_DWT_GetTick() - cycles_start;
+    log_d("UART reconfigured to %lu baud in %lu cycles",
+          (unsigned long)init.BaudRate, (unsigned long)stm_uart->stats.reconf_cycles);
+
+    return ret;
+}
+
+/**
+  * @brief  Translate a generic uart configuration into HAL init fields
+  * @param  cfg: Pointer to generic configuration
+  * @param  init: HAL init structure to update, other fields are kept
+  * @note   STM32 word length counts the parity bit.
+  * @retval 0 on success, -ERR_INVAL if the format is not supported
+  */
+static int32_t stm32_uart_cfg_to_init(const struct uart_configure *cfg, UART_InitTypeDef *init)
+{
+    bool parity;
+
+    if (cfg->baud_rate == 0U) {
+        return -ERR_INVAL;
+    }
+
+    switch (cfg->parity) {
+    case PARITY_NONE:
+        init->Parity = UART_PARITY_NONE;
+        break;
+    case PARITY_ODD:
+        init->Parity = UART_PARITY_ODD;
+        break;
+    case PARITY_EVEN:
+        init->Parity = UART_PARITY_EVEN;
+        break;
+    default:
+        return -ERR_INVAL;
+    }
+    parity = (cfg->parity != PARITY_NONE) ? true : false;
+
+    switch (cfg->data_bits) {
+    case DATA_BITS_7:
+        /* 7 data bits plus parity fit the 8-bit frame of every part,
+           plain 7-bit frames need UART_WORDLENGTH_7B (not on F1) */
+        if (parity) {
+            init->WordLength = UART_WORDLENGTH_8B;
+            break;
+        }
+#if defined(UART_WORDLENGTH_7B)
+        init->WordLength = UART_WORDLENGTH_7B;
+        break;
+#else
+        return -ERR_INVAL;
+#endif
+    case DATA_BITS_8:
+        init->WordLength = parity ? UART_WORDLENGTH_9B : UART_WORDLENGTH_8B;
+        break;
+    case DATA_BITS_9:
+        /* 9 data bits make HAL move uint16_t per character, the FIFOs and
+           RX cache are byte buffers, and 9 bits plus parity do not fit */
+        return -ERR_INVAL;
+    default:
+        return -ERR_INVAL;
+    }
+
+    switch (cfg->stop_bits) {
+    case STOP_BITS_1:
+        init->StopBits = UART_STOPBITS_1;
+        break;
+    case STOP_BITS_2:
+        init->StopBits = UART_STOPBITS_2;
+        break;
+    default:
+        return -ERR_INVAL;
+    }
+
+    init->BaudRate = cfg->baud_rate;
+
+    return 0;
 }
 
+/**
+  * @brief  Check whether the transmitter can accept a new segment
+  * @param  port: Pointer to uart device
+  * @note   In DMA mode the port is reported free as soon as the TX DMA
+  *         finished, so the next segment is queued while the last bytes of
+  *         the previous one are still on the wire.
+  * @retval true if busy, false otherwise
+  */
 static bool STM32_UART_TxIsBusy(struct uart *port)
 {
     struct stm32_uart *stm_uart = (struct stm32_uart *)port->prv_data;
 
+    if (stm_uart->huart->hdmatx != NULL) {
+        return (stm_uart->tx_state == STM32_UART_TX_DMA) ? true : false;
+    }
+
     return (stm_uart->huart->gState == HAL_UART_STATE_BUSY_TX) ? true : false;
 }
 
@@ -275,6 +517,7 @@ static int32_t STM32_UART_Transmit(Uart_t *port, const void *buf, size_t size)
     struct stm32_uart *stm_uart;
     HAL_StatusTypeDef status;
     const uint8_t *data;
+    int32_t ret;
 
     /* port, buf and size are guaranteed valid by start_transfer (the sole caller):
      *   - port:    non-NULL, validated upstream
@@ -289,17 +532,105 @@ static int32_t STM32_UART_Transmit(Uart_t *port, const void *buf, size_t size)
     stm_uart = (struct stm32_uart *)port->prv_data;
     data     = (const uint8_t *)buf;
 
+    /* Transmitter owned by a bridge */
+    if (stm_uart->bridge_src != NULL) {
+        return -ERR_BUSY;
+    }
+
     if (stm_uart->huart->hdmatx != NULL) {
-        status = HAL_UART_Transmit_DMA(stm_uart->huart, data, (uint16_t)size);
+        ret = stm32_uart_tx_dma_start(stm_uart, data, (uint16_t)size);
+        if (ret != 0) {
+            return ret;
+        }
     } else {
+        stm32_uart_de_write(stm_uart, true);
         status = HAL_UART_Transmit_IT(stm_uart->huart, data, (uint16_t)size);
+        if (status != HAL_OK) {
+            log_e("HAL_UART_Transmit_IT failed");
+            return -ERR_IO;
+        }
     }
 
-    if (status != HAL_OK) {
-        log_e("HAL_UART_Transmit_DMA/IT failed");
+    /* Only segments actually handed to the hardware are counted */
+    stm_uart->stats.tx_bytes += (uint32_t)size;
+    if (size > stm_uart->stats.tx_max_seg_len) {
+        stm_uart->stats.tx_max_seg_len = (uint16_t)size;
+    }
+
+    return 0;
+}
+
+/**
+  * @brief  Queue one TX segment on the DMA pipeline
+  * @param  stm_uart: Pointer to stm32 uart context
+  * @param  data: Pointer to segment data
+  * @param  size: Number of bytes in the segment
+  * @note   The TX DMA is driven directly instead of through
+  *         HAL_UART_Transmit_DMA, whose gState stays BUSY_TX until the UART
+  *         TC interrupt and would force an idle gap between segments.
+  *         gState is still held BUSY_TX for the whole stream so other HAL
+  *         users see the transmitter as owned.
+  * @retval 0 on success, negative error code on failure
+  */
+static int32_t stm32_uart_tx_dma_start(struct stm32_uart *stm_uart, const uint8_t *data, uint16_t size)
+{
+    UART_HandleTypeDef *huart = stm_uart->huart;
+    uint32_t level;
+    uint8_t prev_state;
+
+    level = __get_PRIMASK();
+    __disable_irq();
+
+    prev_state = stm_uart->tx_state;
+    if (prev_state == STM32_UART_TX_DMA) {
+        __set_PRIMASK(level);
+        return -ERR_BUSY;
+    }
+
+    if (prev_state == STM32_UART_TX_IDLE) {
+        if (huart->gState != HAL_UART_STATE_READY) {
+            __set_PRIMASK(level);
+            return -ERR_BUSY;
+        }
+        huart->gState    = HAL_UART_STATE_BUSY_TX;
+        huart->ErrorCode = HAL_UART_ERROR_NONE;
+
+        stm32_uart_de_write(stm_uart, true);
+
+        huart->hdmatx->XferCpltCallback     = stm32_uart_dma_tx_cplt;
+        huart->hdmatx->XferHalfCpltCallback = NULL;
+        huart->hdmatx->XferErrorCallback    = stm32_uart_dma_tx_error;
+        huart->hdmatx->XferAbortCallback    = NULL;
+
+        __HAL_UART_CLEAR_FLAG(huart, UART_FLAG_TC);
+    } else {
+        /* Previous segment still shifting out: its end-of-line TC is no longer the end.
+         * DMA writes to DR do not clear a TC already set during the drain. */
+        __HAL_UART_DISABLE_IT(huart, UART_IT_TC);
+        __HAL_UART_CLEAR_FLAG(huart, UART_FLAG_TC);
+    }
+
+    stm_uart->tx_state = STM32_UART_TX_DMA;
+    __set_PRIMASK(level);
+
+    if (HAL_DMA_Start_IT(huart->hdmatx, (uint32_t)data,
+                         (uint32_t)UART_TX_DATA_REG(huart), size) != HAL_OK) {
+        CLEAR_BIT(huart->Instance->CR3, USART_CR3_DMAT);
+        if (prev_state == STM32_UART_TX_DRAIN) {
+            /* The previous segment still ends on TC, which releases DE */
+            stm_uart->tx_state = STM32_UART_TX_DRAIN;
+            __HAL_UART_ENABLE_IT(huart, UART_IT_TC);
+        } else {
+            stm32_uart_de_write(stm_uart, false);
+            stm_uart->tx_state = STM32_UART_TX_IDLE;
+            huart->gState      = HAL_UART_STATE_READY;
+        }
+        log_e("HAL_DMA_Start_IT failed");
         return -ERR_IO;
     }
 
+    SET_BIT(huart->Instance->CR3, USART_CR3_DMAT);
+
     return 0;
 }
 
@@ -316,6 +647,29 @@ static int32_t STM32_UART_StartReceive(Uart_t *port)
     // 重置位置计数器
     stm_uart->last_pos = 0;
 
+    stm_uart->stats.rx_restarts++;
+    stm_uart->idle_masked = 0U;
+
+    /* Restarting breaks ring contiguity, drop any partial frame */
+    stm_uart->frame_start = 0U;
+    stm_uart->frame_len   = 0U;
+    stm_uart->frame_need  = 0U;
+    stm_uart->frame_hdr   = (stm_uart->frame_mode == (uint8_t)BSP_UART_FRAME_LEN16) ? 2U : 1U;
+
+    /* Bridged bytes not yet handed to the peer are overwritten from index 0 on */
+    if (stm_uart->bridge_peer != NULL) {
+        stm_uart->stats.bridge_dropped += stm_uart->bridge_in - stm_uart->bridge_out;
+        stm_uart->bridge_base = 0U;
+        stm_uart->bridge_in   = 0U;
+        stm_uart->bridge_out  = 0U;
+        stm_uart->bridge_paused = 0U;   /* HAL sets DMAR again below */
+    }
+
+    /* A circular RX DMA (configured in the DMA MSP) never stops on TC/IDLE,
+     * so the cache becomes a ring and reception is armed only once. */
+    stm_uart->rx_circular = ((stm_uart->huart->hdmarx != NULL) &&
+                             (stm_uart->huart->hdmarx->Init.Mode == DMA_CIRCULAR)) ? 1U : 0U;
+
     // 开启中断接收
     if (stm_uart->huart->hdmarx != NULL) {
         /* 使用DMA模式接收 */
@@ -337,6 +691,8 @@ static int32_t STM32_UART_StartReceive(Uart_t *port)
 
 /**
   * @brief  Initialize STM32 USART hardware
+  * @note   The HAL handles must already be initialized (Instance set), they
+  *         are used to build the callback dispatch table.
   * @retval 0 on success, negative error code on failure
   */
 int BSP_UART_Init(void)
@@ -344,11 +700,15 @@ int BSP_UART_Init(void)
     int32_t ret;
     Uart_t *port;
     uint8_t i;
+    uint8_t slot;
 
     /* Compile-time guard: bsp_conf.h enabled UART count must equal DEV_UART_MAX */
     _Static_assert((int32_t)UART_INDEX_MAX == (int32_t)DEV_UART_MAX,
                    "BSP UART count (UART_INDEX_MAX) != DEV_UART_MAX in dev_cfg.h");
 
+    /* Latency and turnaround stamps run on the DWT cycle counter */
+    BSP_DWT_Init();
+
     /* Bind platform driver context and ops to each generic port */
     for (i = 0U; i < (uint8_t)UART_INDEX_MAX; i++) {
         port = Uart_Find(i);
@@ -358,6 +718,22 @@ int BSP_UART_Init(void)
         port->prv_data       = (void *)&stm_uart_drv[i];
         port->ops            = &stm_uart_ops;
         stm_uart_drv[i].port = port;
+
+        if (stm_uart_drv[i].huart->Instance == NULL) {
+            log_e("UART handle %d not initialized", i);
+            return -ERR_INVAL;
+        }
+        slot = UART_LUT_SLOT(stm_uart_drv[i].huart->Instance);
+        if ((stm_uart_lut[slot] != 0U) && (stm_uart_lut[slot] != (uint8_t)(i + 1U))) {
+            log_e("UART dispatch slot %d collision", slot);
+            return -ERR_INVAL;
+        }
+        stm_uart_lut[slot] = (uint8_t)(i + 1U);
+
+        if (!stm32_uart_dma_declared(stm_uart_drv[i].huart)) {
+            log_e("UART handle %d has DMA linked but BSP_UARTx_USING_DMA is not defined", i);
+            return -ERR_INVAL;
+        }
     }
 
     /* Register each port with its static backing buffers (also inits FIFOs) */
@@ -418,64 +794,779 @@ int BSP_UART_Init(void)
     return 0;
 }
 
+/**
+  * @brief  Select frame delimiting for a port
+  * @param  index: Port index, as used with Uart_Find
+  * @param  mode: Frame mode, BSP_UART_FRAME_NONE restores the byte stream
+  * @param  cb: Called from the RX interrupt with each complete frame
+  * @note   Frame mode needs circular RX DMA since descriptors point into
+  *         the DMA ring; frames are not forwarded to dev_uart.
+  * @retval 0 on success, negative error code on failure
+  */
+int BSP_UART_SetFrameMode(uint8_t index, BSP_UART_FrameMode_t mode, BSP_UART_FrameCb_t cb)
+{
+    struct stm32_uart *stm_uart;
+    uint32_t level;
+
+    if ((index >= (uint8_t)UART_INDEX_MAX) || (mode > BSP_UART_FRAME_LEN16)) {
+        return -ERR_INVAL;
+    }
+
+    stm_uart = &stm_uart_drv[index];
+
+    if (mode != BSP_UART_FRAME_NONE) {
+        if ((cb == NULL) || (stm_uart->bridge_peer != NULL) || (stm_uart->huart->hdmarx == NULL) ||
+            (stm_uart->huart->hdmarx->Init.Mode != DMA_CIRCULAR)) {
+            return -ERR_INVAL;
+        }
+    }
+
+    level = __get_PRIMASK();
+    __disable_irq();
+    stm_uart->frame_mode  = (uint8_t)mode;
+    stm_uart->frame_cb    = cb;
+    stm_uart->frame_start = stm_uart->last_pos;
+    stm_uart->frame_len   = 0U;
+    stm_uart->frame_need  = 0U;
+    stm_uart->frame_hdr   = (mode == BSP_UART_FRAME_LEN16) ? 2U : 1U;
+    __set_PRIMASK(level);
+
+    return 0;
+}
+
+/**
+  * @brief  Enable adaptive RX notification coalescing
+  * @param  index: Port index, as used with Uart_Find
+  * @param  max_latency_us: Latency ceiling, 0 disables coalescing
+  * @note   When an IDLE event delivers fewer bytes than fit in the ceiling
+  *         at the current baud rate, the IDLE interrupt is masked and data
+  *         is delivered by HT/TC or BSP_UART_RxPoll, which the application
+  *         must call at least every max_latency_us. IDLE is unmasked again
+  *         once a poll finds the line quiet. Needs circular RX DMA.
+  * @retval 0 on success, negative error code on failure
+  */
+int BSP_UART_SetRxCoalesce(uint8_t index, uint32_t max_latency_us)
+{
+    struct stm32_uart *stm_uart;
+    uint32_t level;
+
+    if (index >= (uint8_t)UART_INDEX_MAX) {
+        return -ERR_INVAL;
+    }
+
+    stm_uart = &stm_uart_drv[index];
+    if ((max_latency_us != 0U) &&
+        ((stm_uart->huart->hdmarx == NULL) ||
+         (stm_uart->huart->hdmarx->Init.Mode != DMA_CIRCULAR))) {
+        return -ERR_INVAL;
+    }
+
+    level = __get_PRIMASK();
+    __disable_irq();
+    stm_uart->coalesce_us = max_latency_us;
+    stm32_uart_coalesce_update(stm_uart);
+    if ((stm_uart->coalesce_min == 0U) && (stm_uart->idle_masked != 0U)) {
+        stm_uart->idle_masked = 0U;
+        __HAL_UART_CLEAR_IDLEFLAG(stm_uart->huart);
+        __HAL_UART_ENABLE_IT(stm_uart->huart, UART_IT_IDLE);
+    }
+    __set_PRIMASK(level);
+
+    return 0;
+}
+
+/**
+  * @brief  Deliver data pending in coalesced RX rings
+  * @note   Call periodically (timer or tick hook) at the configured latency
+  *         ceiling. Ports without coalescing are skipped.
+  * @retval None
+  */
+void BSP_UART_RxPoll(void)
+{
+    struct stm32_uart *stm_uart;
+    uint32_t rx_before;
+    uint32_t level;
+    uint16_t pos;
+    uint8_t i;
+
+    for (i = 0U; i < (uint8_t)UART_INDEX_MAX; i++) {
+        stm_uart = &stm_uart_drv[i];
+        if ((stm_uart->idle_masked == 0U) || (stm_uart->rx_circular == 0U)) {
+            continue;
+        }
+
+        level = __get_PRIMASK();
+        __disable_irq();
+
+        pos = (uint16_t)(stm_uart->rx_cache_bufsz -
+                         (uint16_t)__HAL_DMA_GET_COUNTER(stm_uart->huart->hdmarx));
+        rx_before = stm_uart->stats.rx_bytes;
+        stm32_uart_rx_ring_update(stm_uart, pos);
+
+        if (stm_uart->stats.rx_bytes != rx_before) {
+            stm_uart->stats.rx_polls++;
+        } else {
+            /* Line quiet for a whole poll period: back to per-message IDLE */
+            stm_uart->idle_masked = 0U;
+            __HAL_UART_CLEAR_IDLEFLAG(stm_uart->huart);
+            __HAL_UART_ENABLE_IT(stm_uart->huart, UART_IT_IDLE);
+        }
+
+        __set_PRIMASK(level);
+    }
+}
+
+/**
+  * @brief  Forward everything received on one port to another port
+  * @param  rx_index: Receiving port index, needs circular RX DMA
+  * @param  tx_index: Transmitting port index, needs TX DMA
+  * @note   Received DMA segments are transmitted straight from the RX ring
+  *         without passing through dev_uart. While bridged, the RX port
+  *         delivers nothing to its own FIFO and the TX port rejects
+  *         dev_uart writes.
+  * @retval 0 on success, negative error code on failure
+  */
+int BSP_UART_Bridge(uint8_t rx_index, uint8_t tx_index)
+{
+    struct stm32_uart *src;
+    struct stm32_uart *dst;
+    uint32_t level;
+
+    if ((rx_index >= (uint8_t)UART_INDEX_MAX) || (tx_index >= (uint8_t)UART_INDEX_MAX) ||
+        (rx_index == tx_index)) {
+        return -ERR_INVAL;
+    }
+
+    src = &stm_uart_drv[rx_index];
+    dst = &stm_uart_drv[tx_index];
+
+    if ((src->huart->hdmarx == NULL) || (src->huart->hdmarx->Init.Mode != DMA_CIRCULAR) ||
+        (dst->huart->hdmatx == NULL) || (src->frame_mode != (uint8_t)BSP_UART_FRAME_NONE)) {
+        return -ERR_INVAL;
+    }
+
+    level = __get_PRIMASK();
+    __disable_irq();
+
+    if ((src->bridge_peer != NULL) || (dst->bridge_src != NULL) ||
+        (dst->tx_state == STM32_UART_TX_DMA)) {
+        __set_PRIMASK(level);
+        return -ERR_BUSY;
+    }
+
+    src->bridge_base     = src->last_pos;
+    src->bridge_in       = 0U;
+    src->bridge_out      = 0U;
+    src->bridge_inflight = 0U;
+    src->bridge_paused   = 0U;
+    src->bridge_peer     = dst;
+    dst->bridge_src      = src;
+
+    __set_PRIMASK(level);
+
+    return 0;
+}
+
+/**
+  * @brief  Stop forwarding a bridged port
+  * @param  rx_index: Receiving port index passed to BSP_UART_Bridge
+  * @retval 0 on success, -ERR_BUSY while a bridge segment is in flight
+  */
+int BSP_UART_Unbridge(uint8_t rx_index)
+{
+    struct stm32_uart *src;
+    uint32_t level;
+
+    if (rx_index >= (uint8_t)UART_INDEX_MAX) {
+        return -ERR_INVAL;
+    }
+
+    src = &stm_uart_drv[rx_index];
+
+    level = __get_PRIMASK();
+    __disable_irq();
+
+    if (src->bridge_peer == NULL) {
+        __set_PRIMASK(level);
+        return 0;
+    }
+    if (src->bridge_inflight != 0U) {
+        __set_PRIMASK(level);
+        return -ERR_BUSY;
+    }
+
+    if (src->bridge_paused != 0U) {
+        /* The re-sync may hand the backlog to the peer right away */
+        stm32_uart_bridge_resume(src);
+        if (src->bridge_inflight != 0U) {
+            __set_PRIMASK(level);
+            return -ERR_BUSY;
+        }
+    }
+    src->bridge_peer->bridge_src = NULL;
+    src->bridge_peer             = NULL;
+
+    __set_PRIMASK(level);
+
+    return 0;
+}
+
+/**
+  * @brief  Configure RS-485 half-duplex driver-enable control
+  * @param  index: Port index, as used with Uart_Find
+  * @param  cfg: DE configuration, NULL turns software DE control off
+  * @note   Parts with USART DEM drive DE in hardware with the DEAT/DEDT
+  *         guard times; the DE pin must then be muxed to the USART by the
+  *         MSP. Other parts drive de_pin (push-pull output, configured by
+  *         the board) from the TX path: asserted before the first byte,
+  *         released in the TC interrupt after the final stop bit.
+  * @retval 0 on success, negative error code on failure
+  */
+int BSP_UART_SetRs485(uint8_t index, const BSP_UART_Rs485_t *cfg)
+{
+    struct stm32_uart *stm_uart;
+
+    if (index >= (uint8_t)UART_INDEX_MAX) {
+        return -ERR_INVAL;
+    }
+
+    stm_uart = &stm_uart_drv[index];
+
+    if (stm_uart->huart->gState != HAL_UART_STATE_READY) {
+        return -ERR_BUSY;
+    }
+
+    if (cfg == NULL) {
+        stm_uart->de_port = NULL;
+#if defined(USART_CR3_DEM)
+        /* DEM is only writable with the USART disabled */
+        (void)HAL_UART_AbortReceive(stm_uart->huart);
+        stm32_uart_rx_flush(stm_uart);
+        __HAL_UART_DISABLE(stm_uart->huart);
+        CLEAR_BIT(stm_uart->huart->Instance->CR3, USART_CR3_DEM);
+        __HAL_UART_ENABLE(stm_uart->huart);
+        return (int)STM32_UART_StartReceive(stm_uart->port);
+#else
+        return 0;
+#endif
+    }
+
+#if defined(USART_CR3_DEM)
+    if ((cfg->assert_time > 31U) || (cfg->deassert_time > 31U)) {
+        return -ERR_INVAL;
+    }
+
+    (void)HAL_UART_AbortReceive(stm_uart->huart);
+    stm32_uart_rx_flush(stm_uart);
+
+    if (HAL_RS485Ex_Init(stm_uart->huart,
+                         (cfg->de_active_high != 0U) ? UART_DE_POLARITY_HIGH : UART_DE_POLARITY_LOW,
+                         cfg->assert_time, cfg->deassert_time) != HAL_OK) {
+        log_e("HAL_RS485Ex_Init failed");
+        return -ERR_IO;
+    }
+
+    return (int)STM32_UART_StartReceive(stm_uart->port);
+#else
+    if (BSP_GPIO_GetPort(cfg->de_pin) == NULL) {
+        return -ERR_INVAL;
+    }
+
+    stm_uart->de_mask        = PIN_MASK(cfg->de_pin);
+    stm_uart->de_active_high = cfg->de_active_high;
+    stm_uart->de_port        = BSP_GPIO_GetPort(cfg->de_pin);
+    stm32_uart_de_write(stm_uart, false);
+
+    return 0;
+#endif
+}
+
+/**
+  * @brief  Read the statistics of a port
+  * @param  index: Port index, as used with Uart_Find
+  * @param  stats: Output snapshot
+  * @retval 0 on success, negative error code on failure
+  */
+int BSP_UART_GetStats(uint8_t index, BSP_UART_Stats_t *stats)
+{
+    uint32_t level;
+
+    if ((index >= (uint8_t)UART_INDEX_MAX) || (stats == NULL)) {
+        return -ERR_INVAL;
+    }
+
+    level = __get_PRIMASK();
+    __disable_irq();
+    memcpy(stats, &stm_uart_drv[index].stats, sizeof(*stats));
+    __set_PRIMASK(level);
+
+    return 0;
+}
+
+/**
+  * @brief  Clear the statistics of a port
+  * @param  index: Port index, as used with Uart_Find
+  * @retval 0 on success, negative error code on failure
+  */
+int BSP_UART_ResetStats(uint8_t index)
+{
+    uint32_t level;
+
+    if (index >= (uint8_t)UART_INDEX_MAX) {
+        return -ERR_INVAL;
+    }
+
+    level = __get_PRIMASK();
+    __disable_irq();
+    memset(&stm_uart_drv[index].stats, 0, sizeof(stm_uart_drv[index].stats));
+    __set_PRIMASK(level);
+
+    return 0;
+}
+
 /**
   * @brief  Get stm32_uart context from HAL UART handle
+  * @note   Constant time regardless of the number of enabled ports
   * @param  huart HAL UART handle pointer
   * @retval stm32_uart pointer, NULL if not found
   */
 static struct stm32_uart *stm32_uart_from_handle(const UART_HandleTypeDef *huart)
 {
-    if (huart == NULL) {
+    uint8_t idx;
+
+    if ((huart == NULL) || (huart->Instance == NULL)) {
         return NULL;
     }
 
-#ifdef BSP_USING_UART1
-    if (huart == stm_uart_drv[UART1_INDEX].huart) {
-        return &stm_uart_drv[UART1_INDEX];
+    idx = stm_uart_lut[UART_LUT_SLOT(huart->Instance)];
+    if ((idx == 0U) || (stm_uart_drv[idx - 1U].huart != huart)) {
+        return NULL;
     }
-#endif
-#ifdef BSP_USING_UART2
-    if (huart == stm_uart_drv[UART2_INDEX].huart) {
-        return &stm_uart_drv[UART2_INDEX];
+
+    return &stm_uart_drv[idx - 1U];
+}
+
+/**
+  * @brief  Check that DMA linked to a handle is declared in bsp_conf.h
+  * @note   F1 DMA1 serves USART1 TX/RX on channel 4/5, USART2 RX/TX on
+  *         channel 6/7 and USART3 TX/RX on channel 2/3, the same channels the
+  *         SPI and I2C drivers take over (IRQ handlers included) when built
+  *         with DMA. bsp_spi.c and bsp_i2c.c reject the overlap against
+  *         BSP_UARTx_USING_DMA at compile time, so a CubeMX handle with DMA
+  *         linked but not declared would bypass that check.
+  * @param  huart HAL UART handle pointer
+  * @retval true if the handle has no DMA or its DMA is declared
+  */
+static bool stm32_uart_dma_declared(const UART_HandleTypeDef *huart)
+{
+#if defined(STM32F1)
+    if ((huart->hdmatx == NULL) && (huart->hdmarx == NULL)) {
+        return true;
     }
-#endif
-#ifdef BSP_USING_UART3
-    if (huart == stm_uart_drv[UART3_INDEX].huart) {
-        return &stm_uart_drv[UART3_INDEX];
+#if !defined(BSP_UART1_USING_DMA)
+    if (huart->Instance == USART1) {
+        return false;
     }
 #endif
-#ifdef BSP_USING_UART4
-    if (huart == stm_uart_drv[UART4_INDEX].huart) {
-        return &stm_uart_drv[UART4_INDEX];
+#if !defined(BSP_UART2_USING_DMA)
+    if (huart->Instance == USART2) {
+        return false;
     }
 #endif
-#ifdef BSP_USING_UART5
-    if (huart == stm_uart_drv[UART5_INDEX].huart) {
-        return &stm_uart_drv[UART5_INDEX];
+#if !defined(BSP_UART3_USING_DMA)
+    if (huart->Instance == USART3) {
+        return false;
     }
 #endif
-#ifdef BSP_USING_UART6
-    if (huart == stm_uart_drv[UART6_INDEX].huart) {
-        return &stm_uart_drv[UART6_INDEX];
-    }
+#else
+    (void)huart;
 #endif
-#ifdef BSP_USING_UART7
-    if (huart == stm_uart_drv[UART7_INDEX].huart) {
-        return &stm_uart_drv[UART7_INDEX];
+
+    return true;
+}
+
+/**
+  * @brief  Forward the bytes the circular RX DMA produced since the last event
+  * @param  stm_uart: Pointer to stm32 uart context
+  * @param  pos: Producer index in the ring (rx_cache_bufsz - NDTR)
+  * @note   The DMA keeps running, so there is no re-arm window. At most two
+  *         contiguous blocks are forwarded when the producer wrapped.
+  * @retval None
+  */
+static void stm32_uart_rx_ring_update(struct stm32_uart *stm_uart, uint16_t pos)
+{
+    uint16_t last = stm_uart->last_pos;
+
+    if (pos > stm_uart->rx_cache_bufsz) {
+        return;
     }
-#endif
-#ifdef BSP_USING_UART8
-    if (huart == stm_uart_drv[UART8_INDEX].huart) {
-        return &stm_uart_drv[UART8_INDEX];
+
+    if (pos > last) {
+        stm32_uart_rx_deliver(stm_uart, last, pos - last);
+    } else if (pos < last) {
+        /* Producer wrapped: tail of the ring first, then its head */
+        stm32_uart_rx_deliver(stm_uart, last, stm_uart->rx_cache_bufsz - last);
+        if (pos > 0U) {
+            stm32_uart_rx_deliver(stm_uart, 0U, pos);
+        }
+    } else {
+        return;
     }
-#endif
-#ifdef BSP_USING_LPUART1
-    if (huart == stm_uart_drv[LPUART1_INDEX].huart) {
-        return &stm_uart_drv[LPUART1_INDEX];
+
+    stm_uart->last_pos = (pos == stm_uart->rx_cache_bufsz) ? 0U : pos;
+}
+
+/**
+  * @brief  Forward bytes the RX DMA wrote since the last event
+  * @param  stm_uart: Pointer to stm32 uart context
+  * @note   Used after the DMA was stopped; NDTR keeps its value once the
+  *         channel is disabled.
+  * @retval None
+  */
+static void stm32_uart_rx_flush(struct stm32_uart *stm_uart)
+{
+    uint16_t pos;
+
+    if (stm_uart->huart->hdmarx == NULL) {
+        return;
     }
-#endif
 
-    return NULL;
+    pos = (uint16_t)(stm_uart->rx_cache_bufsz -
+                     (uint16_t)__HAL_DMA_GET_COUNTER(stm_uart->huart->hdmarx));
+
+    if (stm_uart->rx_circular != 0U) {
+        stm32_uart_rx_ring_update(stm_uart, pos);
+    } else if (pos > stm_uart->last_pos) {
+        stm32_uart_rx_deliver(stm_uart, stm_uart->last_pos, pos - stm_uart->last_pos);
+        stm_uart->last_pos = pos;
+    }
+}
+
+/**
+  * @brief  Recompute the coalescing threshold from the ceiling and baud rate
+  * @param  stm_uart: Pointer to stm32 uart context
+  * @note   Threshold is the number of characters that fit in the latency
+  *         ceiling, capped at half the ring (the HT/TC notification period).
+  * @retval None
+  */
+static void stm32_uart_coalesce_update(struct stm32_uart *stm_uart)
+{
+    uint64_t chars;
+
+    chars = ((uint64_t)stm_uart->coalesce_us * stm_uart->huart->Init.BaudRate) /
+            ((uint64_t)UART_BITS_PER_CHAR * 1000000ULL);
+    if (chars > (uint64_t)(stm_uart->rx_cache_bufsz / 2U)) {
+        chars = (uint64_t)(stm_uart->rx_cache_bufsz / 2U);
+    }
+
+    stm_uart->coalesce_min = (uint16_t)chars;
+}
+
+/**
+  * @brief  Queue freshly received ring bytes for the bridge peer
+  * @param  src: RX side context
+  * @param  len: Number of new bytes, contiguous with the previous ones
+  * @note   Back-pressure: when the unsent backlog would leave less than a
+  *         quarter of the ring free, the RX DMA request is held off. The
+  *         byte left in RDR then deasserts nRTS if hardware flow control
+  *         is enabled. Without flow control the sender keeps going, the
+  *         bytes arriving meanwhile are lost to overrun, and the oldest
+  *         unsent bytes are overwritten; both are counted.
+  * @retval None
+  */
+static void stm32_uart_bridge_push(struct stm32_uart *src, uint16_t len)
+{
+    uint32_t backlog;
+    uint32_t room;
+
+    src->bridge_in += len;
+
+    backlog = src->bridge_in - src->bridge_out;
+    room    = (uint32_t)src->rx_cache_bufsz - src->bridge_inflight;
+    if (backlog > room) {
+        src->stats.bridge_dropped += backlog - room;
+        src->bridge_out += backlog - room;
+        backlog = room;
+    }
+
+    if ((src->bridge_paused == 0U) &&
+        ((backlog + src->bridge_inflight) > ((uint32_t)src->rx_cache_bufsz * 3U / 4U))) {
+        stm32_uart_bridge_pause(src);
+    }
+
+    stm32_uart_bridge_kick(src);
+}
+
+/**
+  * @brief  Start the next bridge segment if the peer can take one
+  * @param  src: RX side context
+  * @note   Segments are sent straight from the RX ring, one contiguous
+  *         block at a time, and chained from the peer's TX DMA completion.
+  * @retval None
+  */
+static void stm32_uart_bridge_kick(struct stm32_uart *src)
+{
+    struct stm32_uart *dst = src->bridge_peer;
+    uint32_t pending;
+    uint16_t tail;
+    uint16_t len;
+    uint32_t level;
+
+    level = __get_PRIMASK();
+    __disable_irq();
+
+    pending = src->bridge_in - src->bridge_out;
+    if ((dst == NULL) || (pending == 0U) || (src->bridge_inflight != 0U)) {
+        __set_PRIMASK(level);
+        return;
+    }
+
+    tail = (uint16_t)(((uint32_t)src->bridge_base + src->bridge_out) % src->rx_cache_bufsz);
+    len  = src->rx_cache_bufsz - tail;
+    if (pending < len) {
+        len = (uint16_t)pending;
+    }
+
+    if (stm32_uart_tx_dma_start(dst, src->rx_cache_buf + tail, len) == 0) {
+        src->bridge_out      += len;
+        src->bridge_inflight  = len;
+        dst->stats.tx_bytes  += len;
+        if (len > dst->stats.tx_max_seg_len) {
+            dst->stats.tx_max_seg_len = len;
+        }
+    }
+
+    __set_PRIMASK(level);
+}
+
+/**
+  * @brief  Peer finished moving a bridge segment
+  * @param  src: RX side context
+  * @retval None
+  */
+static void stm32_uart_bridge_tx_done(struct stm32_uart *src)
+{
+    src->bridge_inflight = 0U;
+
+    if ((src->bridge_paused != 0U) &&
+        ((src->bridge_in - src->bridge_out) < ((uint32_t)src->rx_cache_bufsz / 2U))) {
+        stm32_uart_bridge_resume(src);
+    }
+
+    stm32_uart_bridge_kick(src);
+}
+
+/**
+  * @brief  Hold off the RX DMA of a bridged port
+  * @param  src: RX side context
+  * @note   With DMAR clear, an IDLE or error interrupt would take the
+  *         non-DMA path of HAL_UART_IRQHandler, which ends the ToIdle
+  *         reception and reports a stale size. IDLE, error and parity
+  *         interrupts are therefore masked until the resume.
+  * @retval None
+  */
+static void stm32_uart_bridge_pause(struct stm32_uart *src)
+{
+    UART_HandleTypeDef *huart = src->huart;
+
+    __HAL_UART_DISABLE_IT(huart, UART_IT_IDLE);
+    __HAL_UART_DISABLE_IT(huart, UART_IT_ERR);
+    __HAL_UART_DISABLE_IT(huart, UART_IT_PE);
+    CLEAR_BIT(huart->Instance->CR3, USART_CR3_DMAR);
+
+    src->bridge_paused = 1U;
+    src->stats.bridge_paused++;
+}
+
+/**
+  * @brief  Let the RX DMA of a bridged port run again
+  * @param  src: RX side context
+  * @note   The SR read starts the IDLE/ORE clear sequence and the DMA read
+  *         of the byte parked in DR completes it. That byte is then past
+  *         its IDLE, so the ring position is re-synced from NDTR here
+  *         instead of waiting for an event that would not come.
+  * @retval None
+  */
+static void stm32_uart_bridge_resume(struct stm32_uart *src)
+{
+    UART_HandleTypeDef *huart = src->huart;
+    uint32_t level;
+    uint32_t sr;
+    uint32_t n;
+    uint16_t pos;
+
+    level = __get_PRIMASK();
+    __disable_irq();
+
+    sr = huart->Instance->SR;
+    if ((sr & USART_SR_ORE) != 0U) {
+        /* At least one byte arrived on a full DR while paused */
+        src->stats.bridge_dropped++;
+    }
+
+    src->bridge_paused = 0U;
+    SET_BIT(huart->Instance->CR3, USART_CR3_DMAR);
+
+    /* The parked byte is taken within a few bus cycles */
+    for (n = 0U; (n < 16U) && ((huart->Instance->SR & USART_SR_RXNE) != 0U); n++) {
+    }
+
+    __HAL_UART_ENABLE_IT(huart, UART_IT_ERR);
+    if (huart->Init.Parity != UART_PARITY_NONE) {
+        __HAL_UART_ENABLE_IT(huart, UART_IT_PE);
+    }
+    if (src->idle_masked == 0U) {
+        __HAL_UART_ENABLE_IT(huart, UART_IT_IDLE);
+    }
+
+    pos = (uint16_t)(src->rx_cache_bufsz - (uint16_t)__HAL_DMA_GET_COUNTER(huart->hdmarx));
+    stm32_uart_rx_ring_update(src, pos);
+
+    __set_PRIMASK(level);
+}
+
+/**
+  * @brief  Drive the software RS-485 DE pin
+  * @param  stm_uart: Pointer to stm32 uart context
+  * @param  active: true to enable the line driver
+  * @retval None
+  */
+static void stm32_uart_de_write(const struct stm32_uart *stm_uart, bool active)
+{
+    if (stm_uart->de_port == NULL) {
+        return;
+    }
+
+    if (active == (stm_uart->de_active_high != 0U)) {
+        stm_uart->de_port->BSRR = stm_uart->de_mask;
+    } else {
+        stm_uart->de_port->BSRR = (uint32_t)stm_uart->de_mask << 16U;
+    }
+}
+
+/**
+  * @brief  Hand a contiguous block of rx_cache_buf to the upper layer
+  * @param  stm_uart: Pointer to stm32 uart context
+  * @param  off: Block start index in rx_cache_buf
+  * @param  len: Block length in bytes
+  * @retval None
+  */
+static void stm32_uart_rx_deliver(struct stm32_uart *stm_uart, uint16_t off, uint16_t len)
+{
+    stm_uart->stats.rx_bytes += len;
+
+    if (stm_uart->bridge_peer != NULL) {
+        stm32_uart_bridge_push(stm_uart, len);
+    } else if (stm_uart->frame_mode != (uint8_t)BSP_UART_FRAME_NONE) {
+        stm32_uart_frame_scan(stm_uart, off, len);
+    } else {
+        Uart_RxIsrHook(stm_uart->port, stm_uart->rx_cache_buf + off, len);
+    }
+}
+
+/**
+  * @brief  Delimit frames in a freshly received block of the RX ring
+  * @param  stm_uart: Pointer to stm32 uart context
+  * @param  off: Block start index in the ring
+  * @param  len: Block length in bytes
+  * @note   Delimiter modes only look for the terminator (memchr), length
+  *         modes only read the header and skip the payload arithmetically.
+  *         Scanner state survives across HT/TC/IDLE boundaries.
+  * @retval None
+  */
+static void stm32_uart_frame_scan(struct stm32_uart *stm_uart, uint16_t off, uint16_t len)
+{
+    const uint8_t *buf = stm_uart->rx_cache_buf;
+    const uint8_t *hit;
+    uint16_t skip;
+    uint8_t  delim;
+
+    if ((stm_uart->frame_mode == (uint8_t)BSP_UART_FRAME_SLIP) ||
+        (stm_uart->frame_mode == (uint8_t)BSP_UART_FRAME_COBS)) {
+        delim = (stm_uart->frame_mode == (uint8_t)BSP_UART_FRAME_SLIP) ?
+                UART_SLIP_END : UART_COBS_DELIM;
+
+        /* frame_len saturates at the ring size: a longer frame is dropped
+           by frame_emit anyway, and the counter must not wrap back into a
+           short bogus frame on a stream without delimiters */
+        while (len > 0U) {
+            hit = (const uint8_t *)memchr(buf + off, delim, len);
+            skip = (hit == NULL) ? len : (uint16_t)(hit - (buf + off));
+            if (skip >= (uint16_t)(stm_uart->rx_cache_bufsz - stm_uart->frame_len)) {
+                stm_uart->frame_len = stm_uart->rx_cache_bufsz;
+            } else {
+                stm_uart->frame_len += skip;
+            }
+            if (hit == NULL) {
+                break;
+            }
+            stm32_uart_frame_emit(stm_uart);
+
+            off += skip + 1U;
+            len -= skip + 1U;
+            stm_uart->frame_start = (off == stm_uart->rx_cache_bufsz) ? 0U : off;
+            stm_uart->frame_len   = 0U;
+        }
+        return;
+    }
+
+    while (len > 0U) {
+        if (stm_uart->frame_hdr > 0U) {
+            stm_uart->frame_need = (uint16_t)((stm_uart->frame_need << 8U) | buf[off]);
+            stm_uart->frame_hdr--;
+            off++;
+            len--;
+            if (stm_uart->frame_hdr == 0U) {
+                stm_uart->frame_start = (off == stm_uart->rx_cache_bufsz) ? 0U : off;
+                stm_uart->frame_len   = 0U;
+            } else {
+                continue;
+            }
+        } else {
+            skip = stm_uart->frame_need - stm_uart->frame_len;
+            if (skip > len) {
+                skip = len;
+            }
+            stm_uart->frame_len += skip;
+            off += skip;
+            len -= skip;
+        }
+
+        if (stm_uart->frame_len == stm_uart->frame_need) {
+            stm32_uart_frame_emit(stm_uart);
+            stm_uart->frame_hdr  = (stm_uart->frame_mode == (uint8_t)BSP_UART_FRAME_LEN16) ? 2U : 1U;
+            stm_uart->frame_need = 0U;
+        }
+    }
+}
+
+/**
+  * @brief  Publish the current frame descriptor
+  * @param  stm_uart: Pointer to stm32 uart context
+  * @note   Empty frames and frames that no longer fit in the ring (their
+  *         head was overwritten) are dropped, the latter are counted in
+  *         stats.frame_dropped.
+  * @retval None
+  */
+static void stm32_uart_frame_emit(struct stm32_uart *stm_uart)
+{
+    BSP_UART_Frame_t frame;
+
+    if ((stm_uart->frame_len == 0U) || (stm_uart->frame_cb == NULL)) {
+        return;
+    }
+
+    if (stm_uart->frame_len >= stm_uart->rx_cache_bufsz) {
+        stm_uart->stats.frame_dropped++;
+        return;
+    }
+
+    frame.ring      = stm_uart->rx_cache_buf;
+    frame.ring_size = stm_uart->rx_cache_bufsz;
+    frame.offset    = stm_uart->frame_start;
+    frame.len       = stm_uart->frame_len;
+
+    stm_uart->frame_cb((uint8_t)(stm_uart - stm_uart_drv), &frame);
 }
 
 /* HAL Callback Functions ----------------------------------------------------*/
@@ -488,7 +1579,88 @@ void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart)
 {
     struct stm32_uart *stm_uart = stm32_uart_from_handle(huart);
 
-    if ((stm_uart != NULL) && (stm_uart->port != NULL)) {
+    if ((stm_uart == NULL) || (stm_uart->port == NULL)) {
+        return;
+    }
+
+    /* TC: the final stop bit is on the wire, the RS-485 driver can let go */
+    if (stm_uart->de_port != NULL) {
+        stm32_uart_de_write(stm_uart, false);
+        if (huart->hdmatx != NULL) {
+            stm_uart->stats.rs485_turnaround = BSP_DWT_GetTick() - stm_uart->tx_done_cycles;
+            if (stm_uart->stats.rs485_turnaround > stm_uart->stats.rs485_turnaround_max) {
+                stm_uart->stats.rs485_turnaround_max = stm_uart->stats.rs485_turnaround;
+            }
+        }
+    }
+
+    if (huart->hdmatx != NULL) {
+        /* Last stop bit of the DMA stream is out, segments were released on DMA TC */
+        stm_uart->tx_state = STM32_UART_TX_IDLE;
+        return;
+    }
+
+    Uart_TxIsrHook(stm_uart->port);
+}
+
+/**
+  * @brief  TX DMA transfer complete callback
+  * @param  hdma: TX DMA handle, Parent is the UART handle
+  * @note   All bytes of the segment are in the USART already. Releasing the
+  *         segment here lets dev_uart queue the next one (or the second half
+  *         of a wrapped FIFO) before the line goes idle.
+  * @retval None
+  */
+static void stm32_uart_dma_tx_cplt(DMA_HandleTypeDef *hdma)
+{
+    UART_HandleTypeDef *huart = (UART_HandleTypeDef *)hdma->Parent;
+    struct stm32_uart *stm_uart = stm32_uart_from_handle(huart);
+
+    if ((stm_uart == NULL) || (stm_uart->port == NULL)) {
+        return;
+    }
+
+    stm_uart->tx_state = STM32_UART_TX_DRAIN;
+    if (stm_uart->bridge_src != NULL) {
+        stm32_uart_bridge_tx_done(stm_uart->bridge_src);
+    } else {
+        Uart_TxIsrHook(stm_uart->port);
+    }
+
+    if (stm_uart->tx_state == STM32_UART_TX_DRAIN) {
+        stm_uart->tx_done_cycles = BSP_DWT_GetTick();
+        /* Nothing queued: HAL finishes the stream on TC after the last stop bit */
+        CLEAR_BIT(huart->Instance->CR3, USART_CR3_DMAT);
+        __HAL_UART_ENABLE_IT(huart, UART_IT_TC);
+    }
+}
+
+/**
+  * @brief  TX DMA transfer error callback
+  * @param  hdma: TX DMA handle, Parent is the UART handle
+  * @retval None
+  */
+static void stm32_uart_dma_tx_error(DMA_HandleTypeDef *hdma)
+{
+    UART_HandleTypeDef *huart = (UART_HandleTypeDef *)hdma->Parent;
+    struct stm32_uart *stm_uart = stm32_uart_from_handle(huart);
+
+    if ((stm_uart == NULL) || (stm_uart->port == NULL)) {
+        return;
+    }
+
+    CLEAR_BIT(huart->Instance->CR3, USART_CR3_DMAT);
+    huart->ErrorCode  |= HAL_UART_ERROR_DMA;
+    huart->gState      = HAL_UART_STATE_READY;
+    stm_uart->tx_state = STM32_UART_TX_IDLE;
+    stm_uart->stats.err_dma++;
+
+    log_e("UART TX DMA error");
+
+    /* Release the segment so the TX FIFO does not stall */
+    if (stm_uart->bridge_src != NULL) {
+        stm32_uart_bridge_tx_done(stm_uart->bridge_src);
+    } else {
         Uart_TxIsrHook(stm_uart->port);
     }
 }
@@ -502,12 +1674,70 @@ void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart)
 void HAL_UARTEx_RxEventCallback(UART_HandleTypeDef *huart, uint16_t Size)
 {
     struct stm32_uart *stm_uart = stm32_uart_from_handle(huart);
-    uint16_t process_size;
+    uint32_t rx_before;
+    uint32_t burst;
+#if defined(BSP_UART_USING_LAT_HIST)
+    uint32_t cycles_start = BSP_DWT_GetTick();
+    uint32_t cycles;
+    uint32_t bin;
+#endif
 
     if ((stm_uart == NULL) || (stm_uart->port == NULL)) {
         return;
     }
 
+    stm_uart->stats.rx_events++;
+    rx_before = stm_uart->stats.rx_bytes;
+
+    stm32_uart_rx_event(stm_uart, Size);
+
+    burst = stm_uart->stats.rx_bytes - rx_before;
+    if (burst > stm_uart->stats.rx_max_burst) {
+        stm_uart->stats.rx_max_burst = (uint16_t)burst;
+    }
+
+#if defined(BSP_UART_USING_LAT_HIST)
+    cycles = BSP_DWT_GetTick() - cycles_start;
+    if (cycles > stm_uart->stats.rx_lat_max) {
+        stm_uart->stats.rx_lat_max = cycles;
+    }
+    bin = (cycles < 32U) ? 0U : ((31U - __CLZ(cycles)) - 4U);
+    if (bin >= BSP_UART_LAT_HIST_BINS) {
+        bin = BSP_UART_LAT_HIST_BINS - 1U;
+    }
+    stm_uart->stats.rx_lat_hist[bin]++;
+#endif
+}
+
+/**
+  * @brief  Handle one reception event
+  * @param  stm_uart: Pointer to stm32 uart context
+  * @param  Size: Number of data available in application reception buffer
+  * @retval None
+  */
+static void stm32_uart_rx_event(struct stm32_uart *stm_uart, uint16_t Size)
+{
+    UART_HandleTypeDef *huart = stm_uart->huart;
+    uint16_t process_size;
+    uint32_t rx_before;
+
+    if (stm_uart->rx_circular != 0U) {
+        /* HT/TC/IDLE only publish the NDTR-derived producer index */
+        rx_before = stm_uart->stats.rx_bytes;
+        stm32_uart_rx_ring_update(stm_uart, Size);
+
+        /* Short bursts separated by gaps: stop taking one IRQ per gap,
+         * HT/TC and BSP_UART_RxPoll deliver within the latency ceiling */
+        if ((huart->RxEventType == HAL_UART_RXEVENT_IDLE) &&
+            (stm_uart->coalesce_min != 0U) &&
+            ((stm_uart->stats.rx_bytes - rx_before) < stm_uart->coalesce_min)) {
+            __HAL_UART_DISABLE_IT(huart, UART_IT_IDLE);
+            stm_uart->idle_masked = 1U;
+            stm_uart->stats.rx_idle_masked++;
+        }
+        return;
+    }
+
     /* Guard against underflow (should not occur in DMA_NORMAL mode) */
     if (Size < stm_uart->last_pos) {
         stm_uart->last_pos = 0U;
@@ -520,9 +1750,7 @@ void HAL_UARTEx_RxEventCallback(UART_HandleTypeDef *huart, uint16_t Size)
     if (huart->RxEventType == HAL_UART_RXEVENT_HT) {
         /* Half-transfer: forward new data, keep last_pos for the TC/IDLE half */
         if (process_size > 0U) {
-            Uart_RxIsrHook(stm_uart->port,
-                           stm_uart->rx_cache_buf + stm_uart->last_pos,
-                           process_size);
+            stm32_uart_rx_deliver(stm_uart, stm_uart->last_pos, process_size);
             stm_uart->last_pos = Size;
         }
     } else if ((huart->RxEventType == HAL_UART_RXEVENT_TC) ||
@@ -530,9 +1758,7 @@ void HAL_UARTEx_RxEventCallback(UART_HandleTypeDef *huart, uint16_t Size)
         /* Transfer complete or idle: forward remaining data, then restart.
          * STM32_UART_StartReceive resets last_pos to 0 internally. */
         if (process_size > 0U) {
-            Uart_RxIsrHook(stm_uart->port,
-                           stm_uart->rx_cache_buf + stm_uart->last_pos,
-                           process_size);
+            stm32_uart_rx_deliver(stm_uart, stm_uart->last_pos, process_size);
         }
         (void)STM32_UART_StartReceive(stm_uart->port);
     } else {
@@ -545,11 +1771,15 @@ void HAL_UARTEx_RxEventCallback(UART_HandleTypeDef *huart, uint16_t Size)
 /**
   * @brief  UART error callback.
   * @param  huart UART handle.
+  * @note   Bytes received before the error are forwarded before reception
+  *         is re-armed, re-arming alone would discard them.
   * @retval None
   */
 void HAL_UART_ErrorCallback(UART_HandleTypeDef *huart)
 {
     struct stm32_uart *stm_uart = stm32_uart_from_handle(huart);
+    uint32_t rx_before;
+    uint16_t pos;
 
     if ((stm_uart == NULL) || (stm_uart->port == NULL)) {
         return;
@@ -557,6 +1787,40 @@ void HAL_UART_ErrorCallback(UART_HandleTypeDef *huart)
 
     log_d("UART errno code = %d", huart->ErrorCode);
 
+    if ((huart->ErrorCode & HAL_UART_ERROR_ORE) != 0U) {
+        stm_uart->stats.err_overrun++;
+    }
+    if ((huart->ErrorCode & HAL_UART_ERROR_FE) != 0U) {
+        stm_uart->stats.err_framing++;
+    }
+    if ((huart->ErrorCode & HAL_UART_ERROR_NE) != 0U) {
+        stm_uart->stats.err_noise++;
+    }
+    if ((huart->ErrorCode & HAL_UART_ERROR_PE) != 0U) {
+        stm_uart->stats.err_parity++;
+    }
+    if ((huart->ErrorCode & HAL_UART_ERROR_DMA) != 0U) {
+        stm_uart->stats.err_dma++;
+    }
+
+    /* Non-blocking error (FE/NE/PE on newer HALs): reception kept running */
+    if (huart->RxState == HAL_UART_STATE_BUSY_RX) {
+        return;
+    }
+
+    /* Blocking error: HAL stopped reception, flush its valid prefix first */
+    rx_before = stm_uart->stats.rx_bytes;
+    if (huart->hdmarx != NULL) {
+        stm32_uart_rx_flush(stm_uart);
+    } else if (huart->RxXferCount < stm_uart->rx_cache_bufsz) {
+        pos = (uint16_t)(stm_uart->rx_cache_bufsz - huart->RxXferCount);
+        if (pos > stm_uart->last_pos) {
+            stm32_uart_rx_deliver(stm_uart, stm_uart->last_pos, pos - stm_uart->last_pos);
+            stm_uart->last_pos = pos;
+        }
+    }
+    stm_uart->stats.err_recovered += stm_uart->stats.rx_bytes - rx_before;
+
     (void)STM32_UART_StartReceive(stm_uart->port);
 }
 
@@ -21,13 +21,97 @@
 #endif /* __cplusplus */
 
 /* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
 
 /* Exported define -----------------------------------------------------------*/
+/* Number of RX latency histogram bins (BSP_UART_USING_LAT_HIST) */
+#define BSP_UART_LAT_HIST_BINS      (16U)
+
 /* Exported typedef ----------------------------------------------------------*/
+/**
+  * @brief  Frame delimiting performed in the RX event path
+  */
+typedef enum
+{
+    BSP_UART_FRAME_NONE = 0,    ///< Byte stream forwarded to dev_uart (default)
+    BSP_UART_FRAME_SLIP,        ///< Frames terminated by SLIP END (0xC0), payload still escaped
+    BSP_UART_FRAME_COBS,        ///< Frames terminated by 0x00, payload still COBS encoded
+    BSP_UART_FRAME_LEN8,        ///< 1 byte length header followed by the payload
+    BSP_UART_FRAME_LEN16,       ///< 2 byte big-endian length header followed by the payload
+} BSP_UART_FrameMode_t;
+
+/**
+  * @brief  Frame descriptor handed to the upper layer
+  * @note   The payload lives in the RX DMA ring and may wrap past its end;
+  *         it is only valid until the DMA laps the ring again.
+  */
+typedef struct
+{
+    const uint8_t *ring;        ///< RX ring base address
+    uint16_t ring_size;         ///< RX ring size in bytes
+    uint16_t offset;            ///< Payload start index in the ring
+    uint16_t len;               ///< Payload length in bytes, delimiter/header excluded
+} BSP_UART_Frame_t;
+
+typedef void (*BSP_UART_FrameCb_t)(uint8_t index, const BSP_UART_Frame_t *frame);
+
+/**
+  * @brief  RS-485 half-duplex driver-enable configuration
+  */
+typedef struct
+{
+    uint8_t  de_pin;            ///< DE pin id as used by bsp_gpio: (port << 4) | pin
+    uint8_t  de_active_high;    ///< 1: DE asserted high, 0: asserted low
+    uint8_t  assert_time;       ///< DEAT in sample times (1/16 or 1/8 bit), hardware DE only
+    uint8_t  deassert_time;     ///< DEDT in sample times (1/16 or 1/8 bit), hardware DE only
+} BSP_UART_Rs485_t;
+
+/**
+  * @brief  Per-port driver statistics
+  */
+typedef struct
+{
+    uint32_t rx_bytes;          ///< Bytes delivered to the upper layer
+    uint32_t tx_bytes;          ///< Bytes handed to the transmitter
+    uint32_t rx_events;         ///< HT/TC/IDLE reception events
+    uint32_t rx_restarts;       ///< Times reception was (re)armed
+    uint32_t rx_polls;          ///< BSP_UART_RxPoll runs that delivered data
+    uint32_t rx_idle_masked;    ///< Times IDLE notifications were coalesced away
+    uint32_t frame_dropped;     ///< Frames discarded for not fitting in the RX cache
+    uint32_t err_overrun;       ///< ORE count
+    uint32_t err_framing;       ///< FE count
+    uint32_t err_noise;         ///< NE count
+    uint32_t err_parity;        ///< PE count
+    uint32_t err_dma;           ///< DMA transfer error count
+    uint32_t err_recovered;     ///< Bytes forwarded from the cache by error recovery
+    uint32_t bridge_dropped;    ///< Bridged bytes overwritten before the peer could send them
+    uint32_t bridge_paused;     ///< Times bridged reception was paused for back-pressure
+    uint32_t rs485_turnaround;  ///< DWT cycles from last TX DMA completion to DE release (GPIO DE)
+    uint32_t rs485_turnaround_max; ///< Worst rs485_turnaround seen
+    uint16_t rx_max_burst;      ///< Most bytes delivered by one RX event
+    uint16_t tx_max_seg_len;    ///< Longest segment handed to the transmitter (not a FIFO fill level)
+    uint32_t reconf_cycles;     ///< DWT cycles spent in the last STM32_UART_Config
+    /**
+      * DWT cycles from RX event entry to delivery return, bin n counts
+      * [2^(n+4), 2^(n+5)) cycles, first and last bins are open-ended.
+      * Only filled when BSP_UART_USING_LAT_HIST is defined.
+      */
+    uint32_t rx_lat_hist[BSP_UART_LAT_HIST_BINS];
+    uint32_t rx_lat_max;        ///< Worst RX event latency in DWT cycles
+} BSP_UART_Stats_t;
+
 /* Exported macro ------------------------------------------------------------*/
 /* Exported variable prototypes ----------------------------------------------*/
 /* Exported function prototypes ----------------------------------------------*/
 int BSP_UART_Init(void);
+int BSP_UART_SetFrameMode(uint8_t index, BSP_UART_FrameMode_t mode, BSP_UART_FrameCb_t cb);
+int BSP_UART_SetRxCoalesce(uint8_t index, uint32_t max_latency_us);
+void BSP_UART_RxPoll(void);
+int BSP_UART_Bridge(uint8_t rx_index, uint8_t tx_index);
+int BSP_UART_Unbridge(uint8_t rx_index);
+int BSP_UART_SetRs485(uint8_t index, const BSP_UART_Rs485_t *cfg);
+int BSP_UART_GetStats(uint8_t index, BSP_UART_Stats_t *stats);
+int BSP_UART_ResetStats(uint8_t index);
 
 #ifdef __cplusplus
 }